@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "autosave.h"
+#include "journal.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+
+enum { REQ_NONE, REQ_DUE, REQ_ASKED };
+
+struct Autosave {
+    ExpenseDB *db;
+    char path[AUTOSAVE_PATH_LEN];
+    int interval, threshold;
+    pthread_t thread;
+    pthread_mutex_t db_lock;    /* held by the foreground while it uses db */
+    pthread_mutex_t lock;       /* guards the rest */
+    pthread_cond_t wake;
+    int stop, request, busy;
+    unsigned long long saved_changes;   /* db->changes the last good save covered */
+    /* the last finished save, until the foreground reports it */
+    int finished, result, asked, rows;
+    unsigned long long seq;
+};
+
+static void *autosave_thread(void *arg) {
+    Autosave *as = arg;
+    pthread_mutex_lock(&as->lock);
+    for (;;) {
+        if (as->request == REQ_NONE && !as->stop) {
+            if (as->interval > 0) {
+                struct timespec until;
+                clock_gettime(CLOCK_REALTIME, &until);
+                until.tv_sec += as->interval;
+                pthread_cond_timedwait(&as->wake, &as->lock, &until);
+            } else {
+                pthread_cond_wait(&as->wake, &as->lock);
+            }
+        }
+        int stop = as->stop, asked = as->request == REQ_ASKED;
+        unsigned long long saved = as->saved_changes;
+        as->request = REQ_NONE;
+        as->busy = 1;
+        pthread_mutex_unlock(&as->lock);
+
+        /* only the copy happens under the DB lock, never the disk write */
+        ExpenseDB snap;
+        int want, copied = 0, result = 0;
+        pthread_mutex_lock(&as->db_lock);
+        unsigned long long changes = as->db->changes;
+        want = asked || changes != saved;
+        if (want && (copied = db_snapshot(as->db, &snap)) && as->db->journal)
+            as->db->journal->save_running = 1;
+        pthread_mutex_unlock(&as->db_lock);
+        if (want) result = copied ? db_save_snapshot(&snap, as->path) : -1;
+
+        pthread_mutex_lock(&as->lock);
+        as->busy = 0;
+        if (want) {
+            as->finished = 1;
+            as->result = result;
+            as->asked = asked;
+            as->rows = copied ? snap.size : 0;
+            as->seq = copied ? snap.journal_seq : 0;
+            if (result > 0) as->saved_changes = changes;
+        }
+        if (copied) db_free(&snap);
+        if (stop) break;
+    }
+    pthread_mutex_unlock(&as->lock);
+    return NULL;
+}
+
+Autosave *autosave_start(ExpenseDB *db, const char *path, int interval, int dirty_threshold) {
+    if ((interval <= 0 && dirty_threshold <= 0) || strlen(path) >= AUTOSAVE_PATH_LEN) return NULL;
+    Autosave *as = calloc(1, sizeof *as);
+    if (!as) return NULL;
+    as->db = db;
+    strcpy(as->path, path);
+    as->interval = interval;
+    as->threshold = dirty_threshold;
+    as->saved_changes = db->changes;
+    pthread_mutex_init(&as->db_lock, NULL);
+    pthread_mutex_init(&as->lock, NULL);
+    pthread_cond_init(&as->wake, NULL);
+    if (pthread_create(&as->thread, NULL, autosave_thread, as) != 0) {
+        pthread_cond_destroy(&as->wake);
+        pthread_mutex_destroy(&as->lock);
+        pthread_mutex_destroy(&as->db_lock);
+        free(as);
+        return NULL;
+    }
+    return as;
+}
+
+void autosave_hold(Autosave *as) {
+    if (as) pthread_mutex_lock(&as->db_lock);
+}
+
+/* called with db_lock held, after the thread is done with the save */
+static void report(Autosave *as, int result, int asked, int rows, unsigned long long seq) {
+    Journal *j = as->db->journal;
+    if (j) j->save_running = 0;
+    if (result > 0) {
+        /* records logged after the copy was taken must stay in the journal */
+        if (j && as->db->journal_seq == seq) journal_reset(j);
+        if (asked) printf("[autosave] Saved %d expense(s) to %s\n", rows, as->path);
+    } else if (result < 0) {
+        puts("[autosave] Not enough memory to copy the DB; it was not saved.");
+    } else {
+        printf("[autosave] Saving to %s failed; changes are still in memory%s.\n", as->path,
+               j ? " and in the journal" : "");
+    }
+}
+
+void autosave_release(Autosave *as) {
+    if (!as) return;
+    ExpenseDB *db = as->db;
+    pthread_mutex_lock(&as->lock);
+    int finished = as->finished, result = as->result, asked = as->asked, rows = as->rows;
+    unsigned long long seq = as->seq;
+    as->finished = 0;
+    if (as->threshold > 0 && as->request == REQ_NONE && !as->busy &&
+        db->changes - as->saved_changes >= (unsigned long long)as->threshold) {
+        as->request = REQ_DUE;
+        pthread_cond_signal(&as->wake);
+    }
+    pthread_mutex_unlock(&as->lock);
+    if (finished) report(as, result, asked, rows, seq);
+    pthread_mutex_unlock(&as->db_lock);
+}
+
+void autosave_poll(Autosave *as) {
+    autosave_hold(as);
+    autosave_release(as);
+}
+
+void autosave_request(Autosave *as) {
+    if (!as) return;
+    pthread_mutex_lock(&as->lock);
+    as->request = REQ_ASKED;
+    pthread_cond_signal(&as->wake);
+    pthread_mutex_unlock(&as->lock);
+}
+
+int autosave_busy(Autosave *as) {
+    if (!as) return 0;
+    pthread_mutex_lock(&as->lock);
+    int busy = as->busy || as->request != REQ_NONE;
+    pthread_mutex_unlock(&as->lock);
+    return busy;
+}
+
+void autosave_stop(Autosave *as) {
+    if (!as) return;
+    pthread_mutex_lock(&as->lock);
+    as->stop = 1;
+    pthread_cond_signal(&as->wake);
+    pthread_mutex_unlock(&as->lock);
+    pthread_join(as->thread, NULL);
+    if (as->finished) report(as, as->result, as->asked, as->rows, as->seq);
+    pthread_cond_destroy(&as->wake);
+    pthread_mutex_destroy(&as->lock);
+    pthread_mutex_destroy(&as->db_lock);
+    free(as);
+}
+
+#else
+
+Autosave *autosave_start(ExpenseDB *db, const char *path, int interval, int dirty_threshold) {
+    (void)db; (void)path; (void)interval; (void)dirty_threshold;
+    return NULL;
+}
+void autosave_hold(Autosave *as) { (void)as; }
+void autosave_release(Autosave *as) { (void)as; }
+void autosave_poll(Autosave *as) { (void)as; }
+void autosave_request(Autosave *as) { (void)as; }
+int autosave_busy(Autosave *as) { (void)as; return 0; }
+void autosave_stop(Autosave *as) { (void)as; }
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include "finance.h"
+
+#define AUTOSAVE_PATH_LEN 256
+
+/* saves db from a background thread: every interval seconds while there
+   are unsaved changes, or once dirty_threshold changes have piled up (0
+   turns either off). The foreground brackets each change to db with
+   autosave_hold/autosave_release, not the prompts around it; reads need
+   no hold, as the thread only reads db too. The thread copies db outside
+   those brackets and writes the copy without holding anything. The copy
+   (db_snapshot) is O(live rows): every row struct plus the category
+   names, with descriptions shared, so a change made meanwhile waits for
+   it, a few milliseconds per 100k rows. Not available on Windows, where
+   autosave_start returns NULL. */
+typedef struct Autosave Autosave;
+
+Autosave *autosave_start(ExpenseDB *db, const char *path, int interval, int dirty_threshold);
+void autosave_hold(Autosave *as);
+void autosave_release(Autosave *as);    /* also reports finished saves */
+void autosave_poll(Autosave *as);       /* reports finished saves, if any */
+void autosave_request(Autosave *as);    /* save soon and say so when done */
+int autosave_busy(Autosave *as);
+void autosave_stop(Autosave *as);       /* final save if needed; waits for it */
+
+#endif
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "stats.h"
+
+#define BATCH_WORDS 64
+#define BATCH_EXPORT "data/export.csv"
+
+/* options a command accepts */
+#define OPT_FILTER     1
+#define OPT_ROWS       2
+#define OPT_ALL_MONTHS 4
+#define OPT_RANGE      8    /* FILTER without --text */
+#define OPT_BY         16
+
+typedef struct {
+    const char *name;
+    const char *arg[4];     /* positionals, NULL past the ones given */
+    const char *category, *from, *to, *text;
+    const char *by;
+    int rows, all_months;
+} BatchCmd;
+
+typedef int (*BatchFn)(ExpenseDB *db, const BatchCmd *c);
+
+/* each command reports its own failure and returns 0; stdout is flushed
+   first so the message lands after the output it follows */
+static void fail(const BatchCmd *c, const char *msg, const char *what) {
+    fflush(stdout);
+    if (what) fprintf(stderr, "%s: %s: %s\n", c->name, msg, what);
+    else fprintf(stderr, "%s: %s\n", c->name, msg);
+}
+
+static int has_filter(const BatchCmd *c) {
+    return c->category || c->from || c->to || c->text;
+}
+
+static int cmd_import(ExpenseDB *db, const BatchCmd *c) {
+    int before = db->live;
+    if (!db_import_csv(db, c->arg[0])) { fail(c, "import failed", c->arg[0]); return 0; }
+    printf("Imported %d expense(s) from %s\n", db->live - before, c->arg[0]);
+    return 1;
+}
+
+static int cmd_export(ExpenseDB *db, const BatchCmd *c) {
+    const char *file = c->arg[0] ? c->arg[0] : BATCH_EXPORT;
+    int ok = has_filter(c) ? db_export_csv_filtered(db, file, c->category, c->from, c->to, c->text)
+                           : db_export_csv(db, file);
+    if (!ok) { fail(c, "export failed", file); return 0; }
+    printf("Exported to %s\n", file);
+    return 1;
+}
+
+static int cmd_add(ExpenseDB *db, const BatchCmd *c) {
+    Expense e;
+    long long cents;
+    memset(&e, 0, sizeof e);
+    if (!is_valid_date(c->arg[0])) { fail(c, "invalid date", c->arg[0]); return 0; }
+    if (!parse_amount(c->arg[2], &cents)) { fail(c, "invalid amount", c->arg[2]); return 0; }
+    if (strlen(c->arg[1]) >= CAT_LEN) { fail(c, "category name too long", c->arg[1]); return 0; }
+    if (c->arg[3] && strlen(c->arg[3]) >= DESCRIPTION_LEN) { fail(c, "description too long", NULL); return 0; }
+    strcpy(e.date, c->arg[0]);
+    e.amount = cents;
+    e.cat_id = category_find(db, c->arg[1]);
+    if (e.cat_id < 0 && add_category(db, c->arg[1])) e.cat_id = category_find(db, c->arg[1]);
+    if (e.cat_id < 0 || !db_add(db, e, c->arg[3] ? c->arg[3] : "")) { fail(c, "out of memory", NULL); return 0; }
+    return 1;
+}
+
+static int cmd_delete(ExpenseDB *db, const BatchCmd *c) {
+    int id = atoi(c->arg[0]);
+    if (id <= 0 || !db_delete_by_id(db, id)) { fail(c, "ID not found", c->arg[0]); return 0; }
+    return 1;
+}
+
+static int cmd_delete_where(ExpenseDB *db, const BatchCmd *c) {
+    if (!has_filter(c)) { fail(c, "give at least one of --category, --from, --to, --text", NULL); return 0; }
+    int n = db_delete_where(db, c->category, c->from, c->to, c->text);
+    if (n < 0) { fail(c, "out of memory", NULL); return 0; }
+    printf("Deleted %d expense(s).\n", n);
+    return 1;
+}
+
+static int cmd_filter(ExpenseDB *db, const BatchCmd *c) {
+    if (c->rows) {
+        db_list_filtered(db, c->category, c->from, c->to, c->text);
+        return 1;
+    }
+    AggGroup t;
+    char amt[AMOUNT_BUF];
+    db_filter_totals(db, c->category, c->from, c->to, c->text, &t);
+    printf("%d matching, total %s\n", t.count, format_amount(t.sum, amt));
+    return 1;
+}
+
+static int cmd_summary(ExpenseDB *db, const BatchCmd *c) {
+    if (!c->arg[0] && !c->all_months) { fail(c, "give MM-YYYY or --all-months", NULL); return 0; }
+    if (c->arg[0]) db_monthly_summary(db, c->arg[0]);
+    if (c->all_months) db_all_months_summary(db);
+    return 1;
+}
+
+static int cmd_range(ExpenseDB *db, const BatchCmd *c) {
+    long long total;
+    char amt[AMOUNT_BUF];
+    if (!db_range_total(db, c->category, c->from, c->to, &total)) { fail(c, "unknown category", c->category); return 0; }
+    printf("Total %s\n", format_amount(total, amt));
+    return 1;
+}
+
+static int cmd_rolling(ExpenseDB *db, const BatchCmd *c) {
+    int window = atoi(c->arg[0]), step = c->arg[1] ? atoi(c->arg[1]) : 1;
+    if (window < 1 || step < 1) { fail(c, "window and step are whole days", NULL); return 0; }
+    if (!db_rolling_report(db, c->category, c->from, c->to, window, step)) {
+        fail(c, "unknown category", c->category);
+        return 0;
+    }
+    return 1;
+}
+
+static int cmd_top(ExpenseDB *db, const BatchCmd *c) {
+    int k = atoi(c->arg[0]), by = 0;
+    if (k < 1) { fail(c, "K must be at least 1", c->arg[0]); return 0; }
+    if (c->by && strcmp(c->by, "category") == 0) by = GROUP_CATEGORY;
+    else if (c->by && strcmp(c->by, "month") == 0) by = GROUP_MONTH;
+    else if (c->by) { fail(c, "--by category or --by month", c->by); return 0; }
+    db_print_top_k(db, c->category, c->from, c->to, c->text, k, by);
+    return 1;
+}
+
+static int cmd_percentiles(ExpenseDB *db, const BatchCmd *c) {
+    db_print_percentiles(db, c->category, c->from, c->to, c->text);
+    return 1;
+}
+
+static int cmd_group(ExpenseDB *db, const BatchCmd *c) {
+    int flags = 0;
+    for (const char *p = c->arg[0]; *p; ++p) {
+        if (*p == 'c' || *p == 'C') flags |= GROUP_CATEGORY;
+        else if (*p == 'm' || *p == 'M') flags |= GROUP_MONTH;
+        else if (*p == 'y' || *p == 'Y') flags |= GROUP_YEAR;
+        else { fail(c, "group by c, m and/or y", c->arg[0]); return 0; }
+    }
+    db_print_aggregate(db, flags);
+    return 1;
+}
+
+static int cmd_list(ExpenseDB *db, const BatchCmd *c) {
+    db_list_grouped(db);
+    if (c->rows) {
+        puts("\nFull list:");
+        db_list(db);
+    }
+    return 1;
+}
+
+static int cmd_stats(ExpenseDB *db, const BatchCmd *c) {
+    (void)db;
+    (void)c;
+    stats_print(stdout);
+    return 1;
+}
+
+static const struct {
+    const char *name;
+    int min_args, max_args;
+    int opts;
+    BatchFn fn;
+} commands[] = {
+    { "import", 1, 1, 0, cmd_import },
+    { "export", 0, 1, OPT_FILTER, cmd_export },
+    { "add", 3, 4, 0, cmd_add },
+    { "delete", 1, 1, 0, cmd_delete },
+    { "delete-where", 0, 0, OPT_FILTER, cmd_delete_where },
+    { "filter", 0, 0, OPT_FILTER | OPT_ROWS, cmd_filter },
+    { "summary", 0, 1, OPT_ALL_MONTHS, cmd_summary },
+    { "range", 0, 0, OPT_RANGE, cmd_range },
+    { "rolling", 1, 2, OPT_RANGE, cmd_rolling },
+    { "top", 1, 1, OPT_FILTER | OPT_BY, cmd_top },
+    { "percentiles", 0, 0, OPT_FILTER, cmd_percentiles },
+    { "group", 1, 1, 0, cmd_group },
+    { "list", 0, 0, OPT_ROWS, cmd_list },
+    { "stats", 0, 0, 0, cmd_stats },
+};
+
+#define NCOMMANDS ((int)(sizeof commands / sizeof commands[0]))
+
+static int find_command(const char *word) {
+    for (int i = 0; i < NCOMMANDS; ++i)
+        if (strcmp(commands[i].name, word) == 0) return i;
+    return -1;
+}
+
+int batch_is_command(const char *word) {
+    return find_command(word) >= 0;
+}
+
+/* takes one option at w[*i]; 0 if the command has no such option */
+static int parse_option(BatchCmd *c, int opts, int n, char **w, int *i) {
+    const char *o = w[*i];
+    if (opts & OPT_ROWS && strcmp(o, "--rows") == 0) { c->rows = 1; return 1; }
+    if (opts & OPT_ALL_MONTHS && strcmp(o, "--all-months") == 0) { c->all_months = 1; return 1; }
+    if (opts & OPT_BY && strcmp(o, "--by") == 0 && *i + 1 < n) { c->by = w[++*i]; return 1; }
+    if (!(opts & (OPT_FILTER | OPT_RANGE)) || *i + 1 >= n) return 0;
+    const char **dst = strcmp(o, "--category") == 0 ? &c->category
+                     : strcmp(o, "--from") == 0 ? &c->from
+                     : strcmp(o, "--to") == 0 ? &c->to
+                     : strcmp(o, "--text") == 0 && opts & OPT_FILTER ? &c->text : NULL;
+    if (!dst) return 0;
+    *dst = w[++*i];
+    if ((dst == &c->from || dst == &c->to) && !is_valid_date(*dst)) {
+        fail(c, "invalid date", *dst);
+        return -1;
+    }
+    return 1;
+}
+
+/* runs the commands in w[0..n); returns how many, or -1 after a failure */
+static int run_words(ExpenseDB *db, int n, char **w) {
+    int done = 0;
+    for (int i = 0; i < n; ++done) {
+        int k = find_command(w[i]);
+        if (k < 0) { fflush(stdout); fprintf(stderr, "unknown command: %s\n", w[i]); return -1; }
+        BatchCmd c;
+        memset(&c, 0, sizeof c);
+        c.name = w[i++];
+        int nargs = 0;
+        while (i < n) {
+            if (strncmp(w[i], "--", 2) == 0) {
+                int r = parse_option(&c, commands[k].opts, n, w, &i);
+                if (r < 0) return -1;
+                if (r == 0) { fail(&c, "unknown option", w[i]); return -1; }
+                i++;
+            } else if (nargs < commands[k].min_args || (nargs < commands[k].max_args && !batch_is_command(w[i]))) {
+                c.arg[nargs++] = w[i++];
+            } else {
+                break;
+            }
+        }
+        if (nargs < commands[k].min_args) { fail(&c, "missing arguments", NULL); return -1; }
+        if (!commands[k].fn(db, &c)) return -1;
+    }
+    return done;
+}
+
+int batch_run_args(ExpenseDB *db, int argc, char **argv) {
+    return run_words(db, argc, argv);
+}
+
+/* splits line into words in place; 0 on an unclosed quote or too many words */
+static int split_words(char *line, char **w, int max, int *n) {
+    char *p = line;
+    *n = 0;
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        if (!*p || *p == '#') return 1;
+        if (*n == max) return 0;
+        if (*p == '"') {
+            w[(*n)++] = ++p;
+            p = strchr(p, '"');
+            if (!p) return 0;
+        } else {
+            w[(*n)++] = p;
+            while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+            if (!*p) return 1;
+        }
+        *p++ = '\0';
+    }
+}
+
+int batch_run_file(ExpenseDB *db, const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f) { fprintf(stderr, "cannot open %s\n", path); return -1; }
+    char line[BATCH_LINE];
+    char *w[BATCH_WORDS];
+    int lineno = 0, done = 0;
+    while (fgets(line, sizeof line, f)) {
+        lineno++;
+        int n, r;
+        const char *err = NULL;
+        if (!strchr(line, '\n') && !feof(f)) err = "line too long";
+        else if (!split_words(line, w, BATCH_WORDS, &n)) err = "unclosed quote or too many words";
+        else if ((r = run_words(db, n, w)) < 0) err = "stopped here";
+        if (err) {
+            fflush(stdout);
+            fprintf(stderr, "%s:%d: %s\n", path, lineno, err);
+            done = -1;
+            break;
+        }
+        done += r;
+    }
+    if (f != stdin) fclose(f);
+    return done;
+}
@@ -0,0 +1,43 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "finance.h"
+
+#define BATCH_LINE 4096
+
+/* scripted use without the menu: commands run one after another against
+   an already loaded db and stop at the first failure, reported on stderr.
+   Adds and deletes print nothing; queries print one line unless given
+   --rows. Saving is left to the caller, once, at the end.
+
+   import FILE                   read a CSV file
+   export [FILE] [FILTER]        write matching rows to FILE (data/export.csv)
+   add DD-MM-YYYY CAT AMOUNT [DESCRIPTION]   creates CAT if needed; a
+                                 DESCRIPTION over 1023 bytes is refused
+   delete ID
+   delete-where FILTER           at least one criterion
+   filter [FILTER] [--rows]      count and total of the matching rows
+   summary [MM-YYYY] [--all-months]
+   range [RANGE]                 total spent, from the per-day totals
+   rolling DAYS [STEP] [RANGE]   spend over the last DAYS days, every STEP days
+   top K [--by category|month] [FILTER]   the K largest expenses
+   percentiles [FILTER]          min, quartiles, p90/p95/p99 and max amount
+   group c|m|y|cm|...            totals by category / month / year
+   list [--rows]                 totals per category, then every row
+   stats                         performance counters
+
+   FILTER is any of --category CAT, --from DD-MM-YYYY, --to DD-MM-YYYY
+   and --text TEXT; RANGE the same without --text. Open dates run to the
+   first / last expense. */
+
+int batch_is_command(const char *word);
+
+/* words as in argv, several commands back to back; returns the number of
+   commands run, or -1 if one failed */
+int batch_run_args(ExpenseDB *db, int argc, char **argv);
+
+/* one command per line of path ("-" = stdin); words are split on blanks,
+   "double quotes" keep blanks in, # starts a comment */
+int batch_run_file(ExpenseDB *db, const char *path);
+
+#endif
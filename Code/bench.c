@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "finance.h"
+#include "kernels.h"
+
+/* benchmark for the ExpenseDB operations: builds a synthetic ledger, times
+   each operation call by call and prints one JSON document to stdout.
+   Progress goes to stderr, listings to the null device. */
+
+#ifdef _WIN32
+  #define NULL_DEVICE "NUL"
+#else
+  #define NULL_DEVICE "/dev/null"
+#endif
+
+#define BENCH_BIN "data/bench.bin"
+#define BENCH_CSV "data/bench.csv"
+#define LAST_YEAR 2025
+
+typedef struct {
+    int rows, categories, years;
+    int desc_min, desc_max;
+    int queries, reps;
+    int encoding;
+    unsigned long long seed;
+} BenchConfig;
+
+/* spend profile of the generated categories; past the table they are "Other N" */
+static const struct {
+    const char *name;
+    int weight;             /* relative frequency */
+    long long lo, hi;       /* cents */
+} PROFILE[] = {
+    { "Food", 30, 150, 2500 },          { "Groceries", 15, 500, 12000 },
+    { "Transport", 15, 100, 4000 },     { "Shopping", 8, 500, 30000 },
+    { "Fun", 8, 300, 8000 },            { "Utilities", 4, 2000, 15000 },
+    { "Health", 4, 500, 20000 },        { "Gym", 3, 1500, 6000 },
+    { "Gifts", 3, 500, 10000 },         { "Education", 2, 1000, 50000 },
+    { "Travel", 2, 5000, 200000 },      { "Rent", 1, 50000, 150000 },
+};
+#define PROFILE_COUNT ((int)(sizeof PROFILE / sizeof PROFILE[0]))
+
+static const char *WORDS[] = {
+    "lunch", "dinner", "coffee", "bus", "metro", "taxi", "fuel", "market", "online", "order",
+    "monthly", "bill", "pharmacy", "movie", "tickets", "books", "course", "fee", "gift", "birthday",
+    "weekend", "trip", "hotel", "flight", "snacks", "groceries", "repair", "phone", "internet", "rent",
+};
+#define WORD_COUNT ((int)(sizeof WORDS / sizeof WORDS[0]))
+
+static unsigned long long rng_state;
+
+static unsigned long long rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static int rng_below(int n) {
+    return (int)(rng() % (unsigned long long)n);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int days_in_month(int month, int year) {
+    if (month == 2) return 28 + (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
+    return month == 4 || month == 6 || month == 9 || month == 11 ? 30 : 31;
+}
+
+static void random_date(const BenchConfig *cfg, char *out) {
+    int year = LAST_YEAR - cfg->years + 1 + rng_below(cfg->years);
+    int month = 1 + rng_below(12);
+    char buf[32];
+    snprintf(buf, sizeof buf, "%02d-%02d-%04d", 1 + rng_below(days_in_month(month, year)), month, year);
+    strcpy(out, buf);   /* always DD-MM-YYYY: years are 1..LAST_YEAR */
+}
+
+static int pick_category(int categories, int total_weight) {
+    int n = categories < PROFILE_COUNT ? categories : PROFILE_COUNT;
+    int r = rng_below(total_weight);
+    for (int c = 0; c < n; ++c)
+        if ((r -= PROFILE[c].weight) < 0) return c;
+    return n + rng_below(categories - n);   /* the "Other" categories, weight 1 each */
+}
+
+static void random_description(const BenchConfig *cfg, char *out) {
+    int want = cfg->desc_min + rng_below(cfg->desc_max - cfg->desc_min + 1), len = 0;
+    out[0] = '\0';
+    while (len < want) len += snprintf(out + len, (size_t)(DESCRIPTION_LEN - len), "%s%s", len ? " " : "",
+                                       WORDS[rng_below(WORD_COUNT)]);
+    out[want] = '\0';
+}
+
+/* ---- results ---- */
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    int i = (int)(p / 100.0 * n + 0.999999) - 1;   /* nearest rank */
+    return sorted[i < 0 ? 0 : i >= n ? n - 1 : i];
+}
+
+/* one JSON object per operation; rows is how many rows one call handles */
+static void report(const char *op, double *us, int n, double rows, int *first) {
+    if (n == 0) return;
+    qsort(us, (size_t)n, sizeof *us, cmp_double);
+    double total = 0;
+    for (int i = 0; i < n; ++i) total += us[i];
+    double secs = total / 1e6;
+    printf("%s    {\"op\": \"%s\", \"calls\": %d, \"rows_per_call\": %.0f, \"total_s\": %.6f, "
+           "\"calls_per_s\": %.1f, \"rows_per_s\": %.1f, \"mean_us\": %.3f, \"p50_us\": %.3f, "
+           "\"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}",
+           *first ? "" : ",\n", op, n, rows, secs, secs > 0 ? n / secs : 0.0, secs > 0 ? n * rows / secs : 0.0,
+           total / n, percentile(us, n, 50), percentile(us, n, 90), percentile(us, n, 99), us[n - 1]);
+    *first = 0;
+    fflush(stdout);
+}
+
+static long file_size(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n;
+}
+
+static int parse_args(int argc, char **argv, BenchConfig *cfg) {
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i];
+        int more = i + 1 < argc;
+        if (strcmp(a, "--rows") == 0 && more) cfg->rows = atoi(argv[++i]);
+        else if (strcmp(a, "--categories") == 0 && more) cfg->categories = atoi(argv[++i]);
+        else if (strcmp(a, "--years") == 0 && more) cfg->years = atoi(argv[++i]);
+        else if (strcmp(a, "--desc") == 0 && i + 2 < argc) {
+            cfg->desc_min = atoi(argv[++i]);
+            cfg->desc_max = atoi(argv[++i]);
+        }
+        else if (strcmp(a, "--queries") == 0 && more) cfg->queries = atoi(argv[++i]);
+        else if (strcmp(a, "--reps") == 0 && more) cfg->reps = atoi(argv[++i]);
+        else if (strcmp(a, "--seed") == 0 && more) cfg->seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(a, "--encoding") == 0 && more) {
+            const char *e = argv[++i];
+            cfg->encoding = strcmp(e, "columns") == 0 ? ENCODING_COLUMNS : strcmp(e, "packed") == 0 ? ENCODING_PACKED
+                          : strcmp(e, "lz") == 0 ? ENCODING_PACKED_LZ : -1;
+        }
+        else return 0;
+    }
+    return cfg->rows > 0 && cfg->categories > 0 && cfg->categories < 10000 && cfg->years > 0 &&
+           cfg->years <= LAST_YEAR && cfg->desc_min >= 0 && cfg->desc_max >= cfg->desc_min &&
+           cfg->desc_max < DESCRIPTION_LEN && cfg->queries > 0 && cfg->reps > 0 && cfg->encoding >= 0;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig cfg = { 200000, 12, 5, 8, 60, 1000, 3, ENCODING_COLUMNS, 42 };
+    if (!parse_args(argc, argv, &cfg)) {
+        fprintf(stderr, "usage: %s [--rows N] [--categories N] [--years N] [--desc MIN MAX] [--queries N]\n"
+                        "       [--reps N] [--encoding columns|packed|lz] [--seed N]\n", argv[0]);
+        return 1;
+    }
+    rng_state = cfg.seed ? cfg.seed : 1;
+    FILE *sink = fopen(NULL_DEVICE, "w");
+    int most = cfg.rows > cfg.queries ? cfg.rows : cfg.queries;
+    if (cfg.reps > most) most = cfg.reps;
+    double *us = malloc((size_t)most * sizeof *us);
+    int *ids = malloc((size_t)cfg.rows * sizeof *ids);
+    char (*names)[CAT_LEN] = malloc((size_t)cfg.categories * CAT_LEN);
+    if (!sink || !us || !ids || !names) {
+        fprintf(stderr, "%s\n", sink ? "Out of memory." : "cannot open " NULL_DEVICE);
+        return 1;
+    }
+    int total_weight = 0;
+    for (int c = 0; c < cfg.categories; ++c) {
+        if (c < PROFILE_COUNT) {
+            snprintf(names[c], CAT_LEN, "%s", PROFILE[c].name);
+            total_weight += PROFILE[c].weight;
+        } else {
+            snprintf(names[c], CAT_LEN, "Other %d", c - PROFILE_COUNT + 1);
+            total_weight++;
+        }
+    }
+
+    printf("{\n  \"config\": {\"rows\": %d, \"categories\": %d, \"years\": %d, \"desc_min\": %d, \"desc_max\": %d, "
+           "\"queries\": %d, \"reps\": %d, \"encoding\": %d, \"seed\": %llu, \"kernel\": \"%s\"},\n  \"results\": [\n",
+           cfg.rows, cfg.categories, cfg.years, cfg.desc_min, cfg.desc_max, cfg.queries, cfg.reps, cfg.encoding,
+           cfg.seed, col_kernel_name());
+    int first = 1;
+    ExpenseDB db;
+    db_init(&db);
+    db_set_encoding(&db, cfg.encoding);
+    for (int c = 0; c < cfg.categories; ++c) add_category(&db, names[c]);
+
+    fprintf(stderr, "db_add: %d rows\n", cfg.rows);
+    char desc[DESCRIPTION_LEN];
+    for (int i = 0; i < cfg.rows; ++i) {
+        Expense e;
+        memset(&e, 0, sizeof e);
+        random_date(&cfg, e.date);
+        int c = pick_category(cfg.categories, total_weight);
+        long long lo = c < PROFILE_COUNT ? PROFILE[c].lo : 100, hi = c < PROFILE_COUNT ? PROFILE[c].hi : 10000;
+        e.cat_id = category_find(&db, names[c]);
+        e.amount = lo + (long long)(rng() % (unsigned long long)(hi - lo + 1));
+        random_description(&cfg, desc);
+        double t0 = now_us();
+        if (!db_add(&db, e, desc)) { fprintf(stderr, "Out of memory at row %d.\n", i); return 1; }
+        us[i] = now_us() - t0;
+        ids[i] = db.next_id - 1;
+    }
+    report("db_add", us, cfg.rows, 1, &first);
+
+    /* a month of one category, a week of everything, or a word anywhere */
+    fprintf(stderr, "db_list_filtered: %d queries\n", cfg.queries);
+    for (int q = 0; q < cfg.queries; ++q) {
+        char from[24], to[24];
+        const char *cat = "", *text = "";
+        int year = LAST_YEAR - cfg.years + 1 + rng_below(cfg.years), month = 1 + rng_below(12);
+        int kind = rng_below(4), day = 1 + rng_below(days_in_month(month, year) - 6);
+        from[0] = to[0] = '\0';
+        if (kind < 2) {
+            cat = names[pick_category(cfg.categories, total_weight)];
+            snprintf(from, sizeof from, "01-%02d-%04d", month, year);
+            snprintf(to, sizeof to, "%02d-%02d-%04d", days_in_month(month, year), month, year);
+        } else if (kind == 2) {
+            snprintf(from, sizeof from, "%02d-%02d-%04d", day, month, year);
+            snprintf(to, sizeof to, "%02d-%02d-%04d", day + 6, month, year);
+        } else {
+            text = WORDS[rng_below(WORD_COUNT)];
+        }
+        double t0 = now_us();
+        db_list_filtered_to(sink, &db, cat, from, to, text);
+        us[q] = now_us() - t0;
+    }
+    report("db_list_filtered", us, cfg.queries, 1, &first);
+
+    fprintf(stderr, "db_monthly_summary: %d queries\n", cfg.queries);
+    for (int q = 0; q < cfg.queries; ++q) {
+        char ym[16];
+        snprintf(ym, sizeof ym, "%02d-%04d", 1 + rng_below(12), LAST_YEAR - cfg.years + 1 + rng_below(cfg.years));
+        double t0 = now_us();
+        db_monthly_summary_to(sink, &db, ym);
+        us[q] = now_us() - t0;
+    }
+    report("db_monthly_summary", us, cfg.queries, 1, &first);
+
+    fprintf(stderr, "db_list_grouped: %d reps\n", cfg.reps);
+    for (int r = 0; r < cfg.reps; ++r) {
+        double t0 = now_us();
+        db_list_grouped_to(sink, &db);
+        us[r] = now_us() - t0;
+    }
+    report("db_list_grouped", us, cfg.reps, db.live, &first);
+
+    /* whole-file operations, rows_per_call = the ledger */
+    int rows = db.live;
+    fprintf(stderr, "save/load binary, export/import CSV: %d reps\n", cfg.reps);
+    for (int r = 0; r < cfg.reps; ++r) {
+        double t0 = now_us();
+        if (!db_save_binary(&db, BENCH_BIN)) { fprintf(stderr, "Cannot write %s.\n", BENCH_BIN); return 1; }
+        us[r] = now_us() - t0;
+    }
+    report("db_save_binary", us, cfg.reps, rows, &first);
+    for (int r = 0; r < cfg.reps; ++r) {
+        ExpenseDB tmp;
+        db_init(&tmp);
+        double t0 = now_us();
+        int ok = db_load_binary(&tmp, BENCH_BIN);
+        us[r] = now_us() - t0;
+        if (!ok || tmp.live != rows) { fprintf(stderr, "Reloading %s failed.\n", BENCH_BIN); return 1; }
+        db_free(&tmp);
+    }
+    report("db_load_binary", us, cfg.reps, rows, &first);
+    for (int r = 0; r < cfg.reps; ++r) {
+        double t0 = now_us();
+        if (!db_export_csv(&db, BENCH_CSV)) { fprintf(stderr, "Cannot write %s.\n", BENCH_CSV); return 1; }
+        us[r] = now_us() - t0;
+    }
+    report("db_export_csv", us, cfg.reps, rows, &first);
+    for (int r = 0; r < cfg.reps; ++r) {
+        ExpenseDB tmp;
+        db_init(&tmp);
+        double t0 = now_us();
+        int ok = db_import_csv(&tmp, BENCH_CSV);
+        us[r] = now_us() - t0;
+        if (!ok || tmp.live != rows) { fprintf(stderr, "Importing %s failed.\n", BENCH_CSV); return 1; }
+        db_free(&tmp);
+    }
+    report("db_import_csv", us, cfg.reps, rows, &first);
+    long bin_bytes = file_size(BENCH_BIN), csv_bytes = file_size(BENCH_CSV);
+    remove(BENCH_BIN);
+    remove(BENCH_CSV);
+
+    /* a tenth of the rows in random order, short of the compaction threshold */
+    int ndel = cfg.rows / 10 ? cfg.rows / 10 : 1;
+    fprintf(stderr, "db_delete_by_id: %d rows\n", ndel);
+    for (int i = 0; i < ndel; ++i) {
+        int j = i + rng_below(cfg.rows - i), t = ids[i];
+        ids[i] = ids[j];
+        ids[j] = t;
+    }
+    for (int i = 0; i < ndel; ++i) {
+        double t0 = now_us();
+        db_delete_by_id(&db, ids[i]);
+        us[i] = now_us() - t0;
+    }
+    report("db_delete_by_id", us, ndel, 1, &first);
+
+    printf("\n  ],\n  \"files\": {\"binary_bytes\": %ld, \"csv_bytes\": %ld}\n}\n", bin_bytes, csv_bytes);
+    db_free(&db);
+    fclose(sink);
+    free(names);
+    free(ids);
+    free(us);
+    return 0;
+}
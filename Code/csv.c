@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csv.h"
+#include "stats.h"
+
+#ifdef _WIN32
+  #define CSV_NO_MMAP 1
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+  #define CSV_SIMD 1
+  #include <immintrin.h>
+#endif
+
+
+int csv_open(CsvBuffer *b, const char *filename) {
+    b->data = NULL;
+    b->size = 0;
+    b->mapped = 0;
+#ifndef CSV_NO_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            close(fd);
+            b->data = p;
+            b->size = (size_t)st.st_size;
+            b->mapped = 1;
+            STAT_COUNT(bytes_read, b->size);
+            return 1;
+        }
+    }
+    close(fd);
+#endif
+    /* no mmap (or an empty/special file): read it into memory */
+    FILE *f = fopen(filename, "rb");
+    if (!f) return 0;
+    size_t cap = 1 << 16, n = 0;
+    char *buf = malloc(cap);
+    while (buf) {
+        size_t got = fread(buf + n, 1, cap - n, f);
+        n += got;
+        if (n < cap) break;
+        char *tmp = realloc(buf, cap * 2);
+        if (!tmp) { free(buf); buf = NULL; break; }
+        buf = tmp;
+        cap *= 2;
+    }
+    fclose(f);
+    if (!buf) return 0;
+    b->data = buf;
+    b->size = n;
+    STAT_COUNT(bytes_read, n);
+    return 1;
+}
+
+void csv_close(CsvBuffer *b) {
+#ifndef CSV_NO_MMAP
+    if (b->mapped) munmap((void *)b->data, b->size);
+    else
+#endif
+    free((void *)b->data);
+    b->data = NULL;
+    b->size = 0;
+}
+
+
+/* ---- byte scanning: AVX2 / SSE2 with a scalar fallback ---- */
+
+static const char *find_delim_scalar(const char *p, const char *end) {
+    while (p < end && *p != ',' && *p != '\n') p++;
+    return p;
+}
+
+static size_t count_byte_scalar(const char *p, size_t n, char ch) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; ++i) c += p[i] == ch;
+    return c;
+}
+
+#ifdef CSV_SIMD
+static const char *find_delim_sse2(const char *p, const char *end) {
+    const __m128i comma = _mm_set1_epi8(','), nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, nl)));
+        if (m) return p + __builtin_ctz((unsigned)m);
+        p += 16;
+    }
+    return find_delim_scalar(p, end);
+}
+
+static size_t count_byte_sse2(const char *p, size_t n, char ch) {
+    const __m128i want = _mm_set1_epi8(ch);
+    size_t c = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        c += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, want)));
+    }
+    return c + count_byte_scalar(p + i, n - i, ch);
+}
+
+__attribute__((target("avx2")))
+static const char *find_delim_avx2(const char *p, const char *end) {
+    const __m256i comma = _mm256_set1_epi8(','), nl = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, comma),
+                                                                    _mm256_cmpeq_epi8(v, nl)));
+        if (m) return p + __builtin_ctz(m);
+        p += 32;
+    }
+    return find_delim_sse2(p, end);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t count_byte_avx2(const char *p, size_t n, char ch) {
+    const __m256i want = _mm256_set1_epi8(ch);
+    size_t c = 0, i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        c += (size_t)__builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, want)));
+    }
+    return c + count_byte_sse2(p + i, n - i, ch);
+}
+
+static int cpu_has_avx2(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return cached;
+}
+
+static const char *find_delim(const char *p, const char *end) {
+    return cpu_has_avx2() ? find_delim_avx2(p, end) : find_delim_sse2(p, end);
+}
+
+static size_t count_byte(const char *p, size_t n, char ch) {
+    return cpu_has_avx2() ? count_byte_avx2(p, n, ch) : count_byte_sse2(p, n, ch);
+}
+#else
+static const char *find_delim(const char *p, const char *end) {
+    return find_delim_scalar(p, end);
+}
+
+static size_t count_byte(const char *p, size_t n, char ch) {
+    return count_byte_scalar(p, n, ch);
+}
+#endif
+
+size_t csv_count_lines(const char *p, size_t n) {
+    return count_byte(p, n, '\n');
+}
+
+/* cuts [0, n) into at most `parts` pieces that each start at a record.
+   A newline only ends a record when the quotes seen so far pair up, so
+   quoted fields spanning lines never straddle two pieces. bounds needs
+   parts + 1 entries; returns the number of pieces. */
+int csv_split(const char *p, size_t n, int parts, size_t *bounds) {
+    int m = 0;
+    size_t prev = 0, quotes = 0;
+    bounds[0] = 0;
+    for (int k = 1; k < parts && prev < n; ++k) {
+        size_t target = n / (size_t)parts * (size_t)k;
+        if (target <= prev) continue;
+        quotes += count_byte(p + prev, target - prev, '"');
+        size_t i = target;
+        while (i < n) {
+            char c = p[i++];
+            if (c == '"') quotes++;
+            else if (c == '\n' && !(quotes & 1)) break;
+        }
+        bounds[++m] = i;
+        prev = i;
+    }
+    if (bounds[m] < n || m == 0) bounds[++m] = n;
+    return m;
+}
+
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* RFC 4180 record starting at *pos. Fields past max_fields are folded
+   into the last one verbatim, which keeps unquoted commas in a trailing
+   description working the way older exports wrote them. Returns the
+   number of fields seen, or -1 at end of input. */
+int csv_next_record(const char *buf, size_t size, size_t *pos,
+                    CsvField *fields, int max_fields) {
+    const char *p = buf + *pos, *end = buf + size;
+    if (p >= end) return -1;
+    int nf = 0;
+    for (;;) {
+        CsvField f;
+        const char *raw = p;
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        if (p < end && *p == '"') {
+            const char *q = ++p;
+            for (;;) {
+                q = memchr(q, '"', (size_t)(end - q));
+                if (!q) { q = end; break; }
+                if (q + 1 < end && q[1] == '"') { q += 2; continue; }
+                break;
+            }
+            f.ptr = p;
+            f.len = (size_t)(q - p);
+            f.quoted = 1;
+            p = q < end ? q + 1 : end;
+            while (p < end && *p != ',' && *p != '\n') p++; /* junk after the closing quote */
+        } else {
+            const char *q = find_delim(p, end);
+            const char *e = q;
+            while (e > p && is_blank(e[-1])) e--;
+            f.ptr = p;
+            f.len = (size_t)(e - p);
+            f.quoted = 0;
+            p = q;
+        }
+        if (nf == max_fields - 1 && p < end && *p == ',') {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            if (!nl) nl = end;
+            const char *e = nl;
+            while (e > raw && is_blank(e[-1])) e--;
+            while (raw < e && (*raw == ' ' || *raw == '\t')) raw++;
+            f.ptr = raw;
+            f.len = (size_t)(e - raw);
+            f.quoted = 0;
+            p = nl;
+        }
+        if (nf < max_fields) fields[nf] = f;
+        nf++;
+        if (p >= end) break;
+        if (*p++ == '\n') break;
+    }
+    *pos = (size_t)(p - buf);
+    return nf;
+}
+
+/* copies a field as a C string, undoubling "" in quoted fields */
+size_t csv_field_copy(char *dst, size_t cap, const CsvField *f) {
+    if (cap == 0) return 0;
+    size_t n = 0;
+    if (!f->quoted) {
+        n = f->len < cap - 1 ? f->len : cap - 1;
+        memcpy(dst, f->ptr, n);
+    } else {
+        for (size_t i = 0; i < f->len && n < cap - 1; ++i) {
+            dst[n++] = f->ptr[i];
+            if (f->ptr[i] == '"' && i + 1 < f->len && f->ptr[i+1] == '"') i++;
+        }
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+/* exact decimal to cents: "-12.5" gives -1250. A third fraction digit
+   rounds half away from zero and any further ones are ignored. Exponents
+   and other forms go through strtod. Non-numbers give 0 like atof. */
+int csv_parse_cents(const char *p, size_t len, long long *out) {
+    const char *s = p, *end = p + len;
+    int neg = 0;
+    if (s < end && (*s == '-' || *s == '+')) neg = *s++ == '-';
+    unsigned long long whole = 0;
+    int int_digits = 0, frac_digits = 0, cents = 0, round_up = 0, seen_dot = 0;
+    for (; s < end; ++s) {
+        if (*s >= '0' && *s <= '9') {
+            int d = *s - '0';
+            if (!seen_dot) { whole = whole * 10 + (unsigned)d; int_digits++; }
+            else if (frac_digits < 2) cents = cents * 10 + d;
+            else if (frac_digits == 2) round_up = d >= 5;
+            frac_digits += seen_dot;
+        } else if (*s == '.' && !seen_dot) {
+            seen_dot = 1;
+        } else {
+            break;
+        }
+    }
+    if (s == end && int_digits + frac_digits > 0 && int_digits <= 16) {
+        if (frac_digits == 1) cents *= 10;
+        long long v = (long long)whole * 100 + cents + round_up;
+        *out = neg ? -v : v;
+        return 1;
+    }
+    char tmp[64];
+    size_t n = len < sizeof tmp - 1 ? len : sizeof tmp - 1;
+    memcpy(tmp, p, n);
+    tmp[n] = '\0';
+    char *e;
+    double v = strtod(tmp, &e) * 100.0;
+    if (!(v > -9e18 && v < 9e18)) v = 0.0;
+    *out = (long long)(v < 0 ? v - 0.5 : v + 0.5);
+    return e != tmp;
+}
+
+
+/* ---- writer ---- */
+
+#define CSV_WRITE_BUF (1 << 20)
+
+int csv_writer_open(CsvWriter *w, const char *filename) {
+    w->len = 0;
+    w->cap = CSV_WRITE_BUF;
+    w->error = 0;
+    w->buf = malloc(w->cap);
+    if (!w->buf) return 0;
+    w->f = fopen(filename, "wb");
+    if (!w->f) { free(w->buf); return 0; }
+    setvbuf(w->f, NULL, _IONBF, 0); /* we already buffer; skip the stdio copy */
+    return 1;
+}
+
+static void csv_flush(CsvWriter *w) {
+    if (w->len && fwrite(w->buf, 1, w->len, w->f) != w->len) w->error = 1;
+    STAT_COUNT(bytes_written, w->len);
+    w->len = 0;
+}
+
+int csv_writer_close(CsvWriter *w) {
+    csv_flush(w);
+    if (fclose(w->f) != 0) w->error = 1;
+    free(w->buf);
+    w->buf = NULL;
+    return !w->error;
+}
+
+void csv_put_raw(CsvWriter *w, const char *s, size_t n) {
+    if (w->len + n > w->cap) {
+        csv_flush(w);
+        if (n > w->cap) {
+            if (fwrite(s, 1, n, w->f) != n) w->error = 1;
+            STAT_COUNT(bytes_written, n);
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+void csv_put_char(CsvWriter *w, char c) {
+    if (w->len == w->cap) csv_flush(w);
+    w->buf[w->len++] = c;
+}
+
+/* quotes only when needed, doubling embedded quotes (RFC 4180) */
+void csv_put_field(CsvWriter *w, const char *s) {
+    size_t n = strlen(s);
+    int quote = n > 0 && (s[0] == ' ' || s[n-1] == ' ');
+    if (!quote && strpbrk(s, ",\"\r\n")) quote = 1;
+    if (!quote) { csv_put_raw(w, s, n); return; }
+    csv_put_char(w, '"');
+    for (const char *q; (q = strchr(s, '"')); s = q + 1) {
+        csv_put_raw(w, s, (size_t)(q - s) + 1);
+        csv_put_char(w, '"');
+    }
+    csv_put_raw(w, s, strlen(s));
+    csv_put_char(w, '"');
+}
+
+void csv_put_int(CsvWriter *w, long long v) {
+    char tmp[24];
+    int i = sizeof tmp;
+    unsigned long long u = v < 0 ? 0ull - (unsigned long long)v : (unsigned long long)v;
+    do { tmp[--i] = (char)('0' + u % 10); u /= 10; } while (u);
+    if (v < 0) tmp[--i] = '-';
+    csv_put_raw(w, tmp + i, sizeof tmp - (size_t)i);
+}
+
+void csv_put_cents(CsvWriter *w, long long cents) {
+    unsigned long long u = cents < 0 ? 0ull - (unsigned long long)cents : (unsigned long long)cents;
+    if (cents < 0) csv_put_char(w, '-');
+    csv_put_int(w, (long long)(u / 100));
+    char frac[3] = { '.', (char)('0' + u % 100 / 10), (char)('0' + u % 10) };
+    csv_put_raw(w, frac, 3);
+}
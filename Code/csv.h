@@ -0,0 +1,48 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* whole input file, memory-mapped where the platform allows it */
+typedef struct {
+    const char *data;
+    size_t size;
+    int mapped;         /* 1 = mmap, 0 = heap copy */
+} CsvBuffer;
+
+/* one field of a record; ptr/len exclude surrounding quotes and blanks,
+   but doubled "" inside a quoted field are still escaped */
+typedef struct {
+    const char *ptr;
+    size_t len;
+    int quoted;
+} CsvField;
+
+int csv_open(CsvBuffer *b, const char *filename);
+void csv_close(CsvBuffer *b);
+
+size_t csv_count_lines(const char *p, size_t n);
+int csv_split(const char *p, size_t n, int parts, size_t *bounds);
+int csv_next_record(const char *buf, size_t size, size_t *pos,
+                    CsvField *fields, int max_fields);
+size_t csv_field_copy(char *dst, size_t cap, const CsvField *f);
+int csv_parse_cents(const char *p, size_t len, long long *out);
+
+/* large-buffer writer; formats numbers by hand instead of via printf */
+typedef struct {
+    FILE *f;
+    char *buf;
+    size_t len, cap;
+    int error;
+} CsvWriter;
+
+int csv_writer_open(CsvWriter *w, const char *filename);
+int csv_writer_close(CsvWriter *w);
+void csv_put_raw(CsvWriter *w, const char *s, size_t n);
+void csv_put_char(CsvWriter *w, char c);
+void csv_put_field(CsvWriter *w, const char *s);
+void csv_put_int(CsvWriter *w, long long v);
+void csv_put_cents(CsvWriter *w, long long cents);
+
+#endif
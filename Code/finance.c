@@ -2,364 +2,3440 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
 #include "finance.h"
+#include "csv.h"
+#include "journal.h"
+#include "pack.h"
+#include "kernels.h"
+#include "stats.h"
 
 #ifdef _WIN32
   #include <direct.h>
   #define MKDIR(dir) _mkdir(dir)
+  #define FSEEK64(f, off, how) _fseeki64(f, (__int64)(off), how)
+  #define FTELL64(f) _ftelli64(f)
 #else
   #include <sys/stat.h>
+  #include <pthread.h>
+  #include <unistd.h>
   #define MKDIR(dir) mkdir(dir, 0755)
+  #define FSEEK64(f, off, how) fseeko(f, (off_t)(off), how)
+  #define FTELL64(f) ftello(f)
 #endif
 
 
-static char *next_token(char **cur, char delim) {
-    if (!cur || !*cur) return NULL;
-    char *start = *cur;
-    if (*start == '\0') return NULL;
-    char *p = start;
-    while (*p && *p != delim && *p != '\r' && *p != '\n') p++;
-    if (*p == delim) {
-        *p = '\0';
-        *cur = p + 1;
+static void ensure_data_dir(void) {
+    MKDIR("data");
+}
+
+static int date_to_key(const char *d) {
+    if (!d || strlen(d) < 10) return -1;
+    int day = (d[0]-'0')*10 + (d[1]-'0');
+    int mon = (d[3]-'0')*10 + (d[4]-'0');
+    int year = (d[6]-'0')*1000 + (d[7]-'0')*100 + (d[8]-'0')*10 + (d[9]-'0');
+    if (day <=0 || mon <=0 || year <=0) return -1;
+    return year*10000 + mon*100 + day;
+}
+
+/* "MM-YYYY" -> YYYYMM00, or -1 */
+static int month_to_key(const char *ym) {
+    if (!ym || strlen(ym) < 7 || ym[2] != '-') return -1;
+    for (int i = 0; i < 7; ++i) if (i != 2 && !isdigit((unsigned char)ym[i])) return -1;
+    int mon = (ym[0]-'0')*10 + (ym[1]-'0');
+    int year = (ym[3]-'0')*1000 + (ym[4]-'0')*100 + (ym[5]-'0')*10 + (ym[6]-'0');
+    if (mon < 1 || mon > 12) return -1;
+    return year*10000 + mon*100;
+}
+
+static int count_bits(unsigned x) {
+    int n = 0;
+    while (x) { x &= x - 1; n++; }
+    return n;
+}
+
+/* cents / n, rounded half away from zero like the displayed figures */
+static long long div_round(long long cents, long long n) {
+    return (cents < 0 ? cents - n / 2 : cents + n / 2) / n;
+}
+
+
+/* deleted rows keep their slot with id 0 until the next compaction */
+#define ROW_DEAD(e) ((e)->id == 0)
+#define COMPACT_MIN_DEAD 1024
+
+static unsigned hash_int(unsigned x) {
+    x ^= x >> 16; x *= 0x45d9f3bu;
+    x ^= x >> 16; x *= 0x45d9f3bu;
+    x ^= x >> 16;
+    return x;
+}
+
+/* mixed, not the identity: sequential ids would fill one long run of
+   buckets, and a backward-shift delete walks to the end of its run */
+static unsigned id_hash(int id) {
+    return hash_int((unsigned)id);
+}
+
+static void id_index_put(ExpenseDB *db, int slot) {
+    unsigned mask = (unsigned)db->id_slots_cap - 1;
+    unsigned h = id_hash(db->arr[slot].id) & mask;
+    while (db->id_slots[h] != -1) h = (h + 1) & mask;
+    db->id_slots[h] = slot;
+}
+
+/* the table only grows; a rehash that fits rehashes in place and cannot
+   fail. 0 on no memory, with the table untouched */
+static int id_index_rebuild(ExpenseDB *db, int mincap) {
+    int cap = 16;
+    while (cap < mincap * 2) cap *= 2;
+    if (cap > db->id_slots_cap) {
+        int *tmp = realloc(db->id_slots, (size_t)cap * sizeof(int));
+        if (!tmp) return 0;
+        db->id_slots = tmp;
+        db->id_slots_cap = cap;
+    }
+    cap = db->id_slots_cap;
+    for (int i = 0; i < cap; ++i) db->id_slots[i] = -1;
+    for (int i = 0; i < db->size; ++i) if (!ROW_DEAD(&db->arr[i])) id_index_put(db, i);
+    return 1;
+}
+
+/* linear probing with backward-shift delete, so no hash tombstones are needed */
+static void id_index_remove(ExpenseDB *db, int id) {
+    unsigned mask = (unsigned)db->id_slots_cap - 1;
+    unsigned i = id_hash(id) & mask;
+    while (db->id_slots[i] != -1 && db->arr[db->id_slots[i]].id != id) i = (i + 1) & mask;
+    if (db->id_slots[i] == -1) return;
+    unsigned j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (db->id_slots[j] == -1) break;
+        unsigned k = id_hash(db->arr[db->id_slots[j]].id) & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        db->id_slots[i] = db->id_slots[j];
+        i = j;
+    }
+    db->id_slots[i] = -1;
+}
+
+static int key_of_slot(const ExpenseDB *db, int slot) {
+    return db->arr[slot].date_key;
+}
+
+/* first position in by_date whose key is >= key */
+static int date_lower_bound(const ExpenseDB *db, int key) {
+    int lo = 0, hi = db->size;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (db->hot.key[mid] < key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static void hot_set(ExpenseDB *db, int pos, int slot) {
+    const Expense *e = &db->arr[slot];
+    db->hot.amount[pos] = e->amount;
+    db->hot.key[pos] = e->date_key;
+    db->hot.cat[pos] = ROW_DEAD(e) ? -1 : e->cat_id;
+}
+
+/* by_date position of a slot, or -1 while the index is unsorted */
+static int date_pos(const ExpenseDB *db, int slot) {
+    if (!db->by_date_sorted) return -1;
+    for (int p = date_lower_bound(db, key_of_slot(db, slot)); p < db->size; ++p)
+        if (db->by_date[p] == slot) return p;
+    return -1;
+}
+
+typedef struct { unsigned key; int slot; } KeySlot;
+
+static int slots_in_date_order(const ExpenseDB *db) {
+    for (int i = 1; i < db->size; ++i)
+        if (key_of_slot(db, i) < key_of_slot(db, i - 1)) return 0;
+    return 1;
+}
+
+/* slots are in id order (or, after a sharded load, already in (date, id)
+   order), so a stable sort by key is ordering by (key, id).
+   LSD radix sort, three 11-bit digits of key+1 (so -1 sorts first), in
+   scratch of 2 * db->size entries; unused when the slots are in order. */
+static void date_index_sort(ExpenseDB *db, KeySlot *scratch) {
+    int n = db->size;
+    if (slots_in_date_order(db)) {
+        for (int i = 0; i < n; ++i) db->by_date[i] = i;
+    } else {
+        KeySlot *a = scratch, *b = scratch + n;
+        for (int i = 0; i < n; ++i) { a[i].key = (unsigned)key_of_slot(db, i) + 1u; a[i].slot = i; }
+        for (int shift = 0; shift < 33; shift += 11) {
+            int count[2049] = {0};
+            for (int i = 0; i < n; ++i) count[((a[i].key >> shift) & 2047) + 1]++;
+            for (int d = 0; d < 2048; ++d) count[d + 1] += count[d];
+            for (int i = 0; i < n; ++i) b[count[(a[i].key >> shift) & 2047]++] = a[i];
+            KeySlot *t = a; a = b; b = t;
+        }
+        for (int i = 0; i < n; ++i) db->by_date[i] = a[i].slot;
+    }
+    for (int i = 0; i < n; ++i) hot_set(db, i, db->by_date[i]);
+    db->by_date_sorted = 1;
+}
+
+static KeySlot *date_index_scratch(int rows) {
+    return malloc((size_t)(rows ? rows : 1) * 2 * sizeof(KeySlot));
+}
+
+/* 0 on no memory, with by_date and the hot columns untouched */
+static int date_index_rebuild(ExpenseDB *db) {
+    KeySlot *scratch = NULL;
+    if (!slots_in_date_order(db) && !(scratch = date_index_scratch(db->size))) return 0;
+    date_index_sort(db, scratch);
+    free(scratch);
+    return 1;
+}
+
+#define GROW(p, n) do { void *g_ = realloc((p), (size_t)(n) * sizeof *(p)); if (!g_) return 0; (p) = g_; } while (0)
+
+/* rows, the date index and the hot columns all hold capacity entries */
+static int rows_realloc(ExpenseDB *db, int n) {
+    STAT_COUNT(grows, 1);
+    STAT_COUNT(grow_bytes, (size_t)n * (sizeof(Expense) + 3 * sizeof(int) + sizeof(long long)));
+    GROW(db->arr, n);
+    GROW(db->by_date, n);
+    GROW(db->hot.amount, n);
+    GROW(db->hot.key, n);
+    GROW(db->hot.cat, n);
+    db->capacity = n;
+    return 1;
+}
+
+/* room for at least n rows without further reallocation */
+static int db_reserve(ExpenseDB *db, int n) {
+    if (n * 2 > db->id_slots_cap && !id_index_rebuild(db, n)) return 0;
+    if (n <= db->capacity) return 1;
+    return rows_realloc(db, n);
+}
+
+static int ensure_capacity(ExpenseDB *db) {
+    if ((db->live + 1) * 2 > db->id_slots_cap && !id_index_rebuild(db, db->live + 1)) return 0;
+    if (db->size < db->capacity) return 1;
+    return rows_realloc(db, db->capacity == 0 ? 8 : db->capacity * 2);
+}
+
+/* ---- month sets for shard bookkeeping ---- */
+
+static int month_set_has(const MonthSet *s, int m) {
+    if (s->cap == 0) return 0;
+    unsigned mask = (unsigned)s->cap - 1, h = hash_int((unsigned)m) & mask;
+    while (s->keys[h] != -1) {
+        if (s->keys[h] == m) return 1;
+        h = (h + 1) & mask;
+    }
+    return 0;
+}
+
+static int month_set_add(MonthSet *s, int m) {
+    if (month_set_has(s, m)) return 1;
+    if ((s->count + 1) * 2 > s->cap) {
+        int cap = s->cap ? s->cap * 2 : 64;
+        int *keys = malloc((size_t)cap * sizeof(int));
+        if (!keys) return 0;
+        for (int i = 0; i < cap; ++i) keys[i] = -1;
+        for (int i = 0; i < s->cap; ++i) {
+            if (s->keys[i] == -1) continue;
+            unsigned h = hash_int((unsigned)s->keys[i]) & (unsigned)(cap - 1);
+            while (keys[h] != -1) h = (h + 1) & (unsigned)(cap - 1);
+            keys[h] = s->keys[i];
+        }
+        free(s->keys);
+        s->keys = keys;
+        s->cap = cap;
+    }
+    unsigned mask = (unsigned)s->cap - 1, h = hash_int((unsigned)m) & mask;
+    while (s->keys[h] != -1) h = (h + 1) & mask;
+    s->keys[h] = m;
+    s->count++;
+    return 1;
+}
+
+static void month_set_clear(MonthSet *s) {
+    for (int i = 0; i < s->cap; ++i) s->keys[i] = -1;
+    s->count = 0;
+}
+
+static void month_set_free(MonthSet *s) {
+    free(s->keys);
+    memset(s, 0, sizeof *s);
+}
+
+/* dates that don't give a real YYYY-MM all go to the undated shard */
+static int shard_month(const Expense *e) {
+    int ym = e->date_key / 100;
+    if (e->date_key < 0 || ym % 100 < 1 || ym % 100 > 12 || ym / 100 > 9999) return 0;
+    return ym;
+}
+
+static void shard_touch(ExpenseDB *db, const Expense *e) {
+    if (!month_set_add(&db->shards.dirty, shard_month(e))) db->shards.all_dirty = 1;
+}
+
+/* ---- description arena ---- */
+
+#define ARENA_CHUNK ((size_t)1 << ARENA_CHUNK_BITS)
+
+/* a chunk can be shared with a snapshot being saved in the background,
+   so it carries a count of its owners in front of the text */
+typedef struct {
+    long refs;
+    long pad;
+} ChunkHead;
+
+#ifdef _WIN32
+  #define REFS_ADD(p, n) (*(p) += (n))    /* no background saves */
+#else
+  #define REFS_ADD(p, n) __atomic_add_fetch(p, n, __ATOMIC_ACQ_REL)
+#endif
+
+static char *chunk_new(void) {
+    ChunkHead *h = malloc(sizeof *h + ARENA_CHUNK);
+    if (!h) return NULL;
+    h->refs = 1;
+    return (char *)(h + 1);
+}
+
+static void chunk_share(char *c) {
+    REFS_ADD(&((ChunkHead *)c - 1)->refs, 1);
+}
+
+static void chunk_drop(char *c) {
+    ChunkHead *h = (ChunkHead *)c - 1;
+    if (REFS_ADD(&h->refs, -1) == 0) free(h);
+}
+
+static void arena_free(StringArena *a) {
+    for (int i = 0; i < a->count; ++i) chunk_drop(a->chunks[i]);
+    free(a->chunks);
+    memset(a, 0, sizeof *a);
+}
+
+static int arena_grow(StringArena *a, int need) {
+    if (need > ARENA_MAX_CHUNKS) return 0;
+    if (need <= a->cap) return 1;
+    int cap = a->cap ? a->cap * 2 : 16;
+    while (cap < need) cap *= 2;
+    char **tmp = realloc(a->chunks, (size_t)cap * sizeof *tmp);
+    if (!tmp) return 0;
+    a->chunks = tmp;
+    a->cap = cap;
+    return 1;
+}
+
+/* copies len bytes of s plus a terminator; text never straddles chunks */
+static int arena_put(StringArena *a, const char *s, size_t len, unsigned *ref) {
+    if (a->count == 0 || a->used + len + 1 > ARENA_CHUNK) {
+        if (!arena_grow(a, a->count + 1)) return 0;
+        if (!(a->chunks[a->count] = chunk_new())) return 0;
+        a->count++;
+        a->used = 0;
+    }
+    char *p = a->chunks[a->count - 1] + a->used;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    *ref = (unsigned)(a->count - 1) << ARENA_CHUNK_BITS | a->used;
+    a->used += (unsigned)len + 1;
+    a->live += len + 1;
+    return 1;
+}
+
+/* moves src's chunks to the end of a; refs into src gain the returned base */
+static int arena_adopt(StringArena *a, StringArena *src, unsigned *base) {
+    *base = (unsigned)a->count << ARENA_CHUNK_BITS;
+    if (src->count == 0) return 1;
+    if (!arena_grow(a, a->count + src->count)) return 0;
+    memcpy(a->chunks + a->count, src->chunks, (size_t)src->count * sizeof *src->chunks);
+    a->count += src->count;
+    a->used = src->used;
+    a->live += src->live;
+    free(src->chunks);
+    memset(src, 0, sizeof *src);
+    return 1;
+}
+
+const char *expense_description(const ExpenseDB *db, const Expense *e) {
+    if (e->desc_len == 0) return "";
+    return db->descs.chunks[e->desc_ref >> ARENA_CHUNK_BITS] + (e->desc_ref & (ARENA_CHUNK - 1));
+}
+
+/* stores the row's text, cut to DESCRIPTION_LEN - 1 bytes; callers that
+   take text from users check the length and say so first */
+static int desc_set(ExpenseDB *db, Expense *e, const char *s, size_t len) {
+    if (len > DESCRIPTION_LEN - 1) len = DESCRIPTION_LEN - 1;
+    e->desc_ref = 0;
+    e->desc_len = (unsigned)len;
+    return len == 0 || arena_put(&db->descs, s, len, &e->desc_ref);
+}
+
+static void desc_release(ExpenseDB *db, const Expense *e) {
+    if (e->desc_len == 0) return;
+    db->descs.live -= e->desc_len + 1;
+    db->descs.dead += e->desc_len + 1;
+}
+
+/* once a quarter of the text belongs to deleted rows, copy the live text
+   to fresh chunks in row order. Stays as is if memory is short. */
+static void desc_compact(ExpenseDB *db) {
+    StringArena *old = &db->descs, fresh;
+    if (old->dead < ARENA_CHUNK || old->dead * 4 < old->live + old->dead) return;
+    memset(&fresh, 0, sizeof fresh);
+    unsigned *refs = malloc((size_t)(db->size ? db->size : 1) * sizeof *refs);
+    int ok = refs != NULL;
+    for (int i = 0; ok && i < db->size; ++i) {
+        const Expense *e = &db->arr[i];
+        if (ROW_DEAD(e) || e->desc_len == 0) continue;
+        ok = arena_put(&fresh, expense_description(db, e), e->desc_len, &refs[i]);
+    }
+    if (ok) {
+        for (int i = 0; i < db->size; ++i)
+            if (!ROW_DEAD(&db->arr[i]) && db->arr[i].desc_len) db->arr[i].desc_ref = refs[i];
+        arena_free(old);
+        *old = fresh;
+    } else {
+        arena_free(&fresh);
+    }
+    free(refs);
+}
+
+static void text_index_free(TextIndex *t) {
+    for (int i = 0; i < t->cap; ++i) free(t->lists[i].slots);
+    free(t->lists);
+    memset(t, 0, sizeof *t);
+}
+
+static void cat_dict_free(CategoryDict *d) {
+    free(d->names);
+    free(d->rows);
+    free(d->hash);
+    memset(d, 0, sizeof *d);
+}
+
+static void day_series_free(DaySeries *s) {
+    for (int i = 0; i < s->count; ++i) free(s->blocks[i].tree);
+    free(s->blocks);
+    free(s->outer);
+    memset(s, 0, sizeof *s);
+}
+
+static void day_totals_free(DayTotals *t) {
+    day_series_free(&t->all);
+    for (int c = 0; c < t->ncat; ++c) day_series_free(&t->by_cat[c]);
+    free(t->by_cat);
+    memset(t, 0, sizeof *t);
+}
+
+static void db_init_empty(ExpenseDB *db) {
+    memset(db, 0, sizeof *db);
+    db->next_id = 1;
+    db->by_date_sorted = 1;
+}
+
+void db_init(ExpenseDB *db) {
+    db_init_empty(db);
+    add_category(db, "Food");
+    add_category(db, "Transport");
+    add_category(db, "Shopping");
+    add_category(db, "Gym");
+}
+
+void db_free(ExpenseDB *db) {
+    free(db->arr);
+    free(db->id_slots);
+    free(db->by_date);
+    free(db->hot.amount);
+    free(db->hot.key);
+    free(db->hot.cat);
+    cat_dict_free(&db->cats);
+    arena_free(&db->descs);
+    text_index_free(&db->text);
+    journal_close(db->journal);
+    month_set_free(&db->shards.dirty);
+    month_set_free(&db->shards.loaded);
+    free(db->months.items);
+    free(db->months.hash);
+    day_totals_free(&db->days);
+    db_init_empty(db);
+}
+
+
+static unsigned hash_str(const char *s) {
+    unsigned h = 2166136261u; /* FNV-1a */
+    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    return h;
+}
+
+/* slot holding name, or the empty slot it would go in */
+static unsigned cat_hash_slot(const CategoryDict *d, const char *name) {
+    unsigned mask = (unsigned)d->hash_cap - 1;
+    unsigned h = hash_str(name) & mask;
+    while (d->hash[h] != -1 && strcmp(d->names[d->hash[h]], name) != 0) h = (h + 1) & mask;
+    return h;
+}
+
+static int cat_hash_rebuild(CategoryDict *d, int mincap) {
+    int cap = 16;
+    while (cap < mincap * 2) cap *= 2;
+    if (cap != d->hash_cap) {
+        int *tmp = realloc(d->hash, (size_t)cap * sizeof(int));
+        if (!tmp) return 0;
+        d->hash = tmp;
+        d->hash_cap = cap;
+    }
+    for (int i = 0; i < cap; ++i) d->hash[i] = -1;
+    for (int id = 0; id < d->count; ++id)
+        if (d->names[id][0]) d->hash[cat_hash_slot(d, d->names[id])] = id;
+    return 1;
+}
+
+static void cat_hash_remove(CategoryDict *d, int id) {
+    unsigned mask = (unsigned)d->hash_cap - 1;
+    unsigned i = cat_hash_slot(d, d->names[id]);
+    if (d->hash[i] != id) return;
+    unsigned j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (d->hash[j] == -1) break;
+        unsigned k = hash_str(d->names[d->hash[j]]) & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        d->hash[i] = d->hash[j];
+        i = j;
+    }
+    d->hash[i] = -1;
+}
+
+/* names are stored truncated to CAT_LEN-1, so lookups truncate the same way */
+static void cat_key(char *out, const char *cat) {
+    size_t n = strlen(cat);
+    if (n > CAT_LEN-1) n = CAT_LEN-1;
+    memcpy(out, cat, n);
+    out[n] = '\0';
+}
+
+static int cat_dict_find(const CategoryDict *d, const char *cat) {
+    if (!cat || cat[0] == '\0' || d->hash_cap == 0) return -1;
+    char key[CAT_LEN];
+    cat_key(key, cat);
+    return d->hash[cat_hash_slot(d, key)];
+}
+
+static int cat_dict_grow(CategoryDict *d) {
+    if (d->count < d->capacity) return 1;
+    int newcap = d->capacity == 0 ? 16 : d->capacity * 2;
+    char (*names)[CAT_LEN] = realloc(d->names, (size_t)newcap * CAT_LEN);
+    if (!names) return 0;
+    d->names = names;
+    int *rows = realloc(d->rows, (size_t)newcap * sizeof(int));
+    if (!rows) return 0;
+    d->rows = rows;
+    d->capacity = newcap;
+    return 1;
+}
+
+/* a removed id, so ids handed out after it line up with a saved table */
+static int cat_dict_hole(CategoryDict *d) {
+    if (!cat_dict_grow(d)) return -1;
+    int id = d->count++;
+    d->names[id][0] = '\0';
+    d->rows[id] = 0;
+    return id;
+}
+
+static int cat_dict_intern(CategoryDict *d, const char *cat) {
+    int id = cat_dict_find(d, cat);
+    if (id >= 0) return id;
+    if (!cat || cat[0] == '\0') return -1;
+    if ((d->active + 1) * 2 > d->hash_cap && !cat_hash_rebuild(d, d->active + 1)) return -1;
+    if (!cat_dict_grow(d)) return -1;
+    id = d->count++;
+    cat_key(d->names[id], cat);
+    d->rows[id] = 0;
+    d->active++;
+    d->hash[cat_hash_slot(d, d->names[id])] = id;
+    return id;
+}
+
+int category_find(const ExpenseDB *db, const char *cat) {
+    return cat_dict_find(&db->cats, cat);
+}
+
+int category_exists(const ExpenseDB *db, const char *cat) {
+    return category_find(db, cat) >= 0;
+}
+
+const char *category_name(const ExpenseDB *db, int cat_id) {
+    if (cat_id < 0 || cat_id >= db->cats.count) return "";
+    return db->cats.names[cat_id];
+}
+
+/* id of the category, creating it if needed; -1 on bad name or no memory */
+int category_intern(ExpenseDB *db, const char *cat) {
+    return cat_dict_intern(&db->cats, cat);
+}
+
+int add_category(ExpenseDB *db, const char *cat) {
+    int before = db->cats.active;
+    if (category_intern(db, cat) < 0) return 0;
+    if (db->cats.active != before) {
+        journal_log_category(db, JOP_CAT_ADD, cat, NULL);
+        journal_commit(db);
+    }
+    return 1;
+}
+
+int remove_category(ExpenseDB *db, const char *cat) {
+    int id = category_find(db, cat);
+    if (id < 0) return 0;
+    if (db->cats.rows[id] > 0) return 0; /* in use */
+    if (db->shards.partial) return 0; /* may be in use by shards not loaded */
+    cat_hash_remove(&db->cats, id);
+    db->cats.names[id][0] = '\0';
+    db->cats.active--;
+    journal_log_category(db, JOP_CAT_REMOVE, cat, NULL);
+    journal_commit(db);
+    return 1;
+}
+
+int rename_category(ExpenseDB *db, const char *oldname, const char *newname) {
+    int id = category_find(db, oldname);
+    if (id < 0) return 0;
+    if (!newname || newname[0]=='\0') return 0;
+    if (category_exists(db, newname)) return 0; /* avoid duplicate */
+    /* expenses refer to the id, so only the dictionary entry changes */
+    cat_hash_remove(&db->cats, id);
+    cat_key(db->cats.names[id], newname);
+    db->cats.hash[cat_hash_slot(&db->cats, db->cats.names[id])] = id;
+    journal_log_category(db, JOP_CAT_RENAME, oldname, newname);
+    journal_commit(db);
+    return 1;
+}
+
+void list_categories(const ExpenseDB *db) {
+    if (db->cats.active == 0) { puts("No categories yet."); return; }
+    puts("Categories:");
+    for (int i = 0; i < db->cats.count; ++i)
+        if (db->cats.names[i][0]) printf(" - %s\n", db->cats.names[i]);
+}
+
+
+/* ---- per-day totals (Fenwick trees) ---- */
+
+/* YYYYMMDD -> days since 01-03-0000, -1 without a usable date */
+static int key_to_day(int key) {
+    if (key <= 0) return -1;
+    int y = key / 10000, m = key / 100 % 100, d = key % 100;
+    if (m < 1 || m > 12 || d < 1 || d > 31) return -1;
+    y -= m <= 2;
+    int era = y / 400, yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy;
+}
+
+static int day_to_key(int z) {
+    int era = z / 146097, doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (yoe * 365 + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153, d = doy - (153 * mp + 2) / 5 + 1;
+    int m = mp < 10 ? mp + 3 : mp - 9;
+    return (yoe + era * 400 + (m <= 2)) * 10000 + m * 100 + d;
+}
+
+static void fen_add(long long *t, int n, int i, long long v) {
+    for (; i <= n; i += i & -i) t[i] += v;
+}
+
+static long long fen_sum(const long long *t, int i) {
+    long long s = 0;
+    for (; i > 0; i -= i & -i) s += t[i];
+    return s;
+}
+
+/* per-day values -> tree in place */
+static void fen_build(long long *t, int n) {
+    for (int i = 1; i <= n; ++i) {
+        int j = i + (i & -i);
+        if (j <= n) t[j] += t[i];
+    }
+}
+
+/* first block numbered >= block */
+static int day_series_find(const DaySeries *s, int block) {
+    int lo = 0, hi = s->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (s->blocks[mid].block < block) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* block totals -> outer tree; O(blocks), run when a block is inserted */
+static void day_series_outer(DaySeries *s) {
+    for (int i = 0; i < s->count; ++i) s->outer[i + 1] = s->blocks[i].total;
+    fen_build(s->outer, s->count);
+}
+
+/* the block holding day d, created empty if need be; NULL on no memory */
+static DayBlock *day_series_block(DaySeries *s, int d) {
+    int block = d / DAY_BLOCK, i = day_series_find(s, block);
+    if (i < s->count && s->blocks[i].block == block) return &s->blocks[i];
+    if (s->count == s->capacity) {
+        int cap = s->capacity ? s->capacity * 2 : 4;
+        DayBlock *p = realloc(s->blocks, (size_t)cap * sizeof *p);
+        if (!p) return NULL;
+        s->blocks = p;
+        long long *o = realloc(s->outer, (size_t)(cap + 1) * sizeof *o);
+        if (!o) return NULL;
+        s->outer = o;
+        s->capacity = cap;
+    }
+    long long *tree = calloc(DAY_BLOCK + 1, sizeof(long long));
+    if (!tree) return NULL;
+    memmove(s->blocks + i + 1, s->blocks + i, (size_t)(s->count - i) * sizeof *s->blocks);
+    s->blocks[i].block = block;
+    s->blocks[i].total = 0;
+    s->blocks[i].tree = tree;
+    s->count++;
+    day_series_outer(s);
+    return &s->blocks[i];
+}
+
+static void day_series_add(DaySeries *s, int d, long long v) {
+    int i = day_series_find(s, d / DAY_BLOCK);
+    if (i == s->count || s->blocks[i].block != d / DAY_BLOCK) return;
+    fen_add(s->blocks[i].tree, DAY_BLOCK, d % DAY_BLOCK + 1, v);
+    fen_add(s->outer, s->count, i + 1, v);
+    s->blocks[i].total += v;
+}
+
+/* sum over day numbers from..to: the blocks it touches by the outer tree,
+   less what lies outside the range in its two end blocks */
+static long long day_series_range(const DaySeries *s, int from, int to) {
+    if (from < 0) from = 0;
+    if (from > to) return 0;
+    int i = day_series_find(s, from / DAY_BLOCK), j = day_series_find(s, to / DAY_BLOCK + 1);
+    if (i >= j) return 0;
+    long long sum = fen_sum(s->outer, j) - fen_sum(s->outer, i);
+    const DayBlock *first = &s->blocks[i], *last = &s->blocks[j - 1];
+    if (first->block == from / DAY_BLOCK) sum -= fen_sum(first->tree, from % DAY_BLOCK);
+    if (last->block == to / DAY_BLOCK) sum -= last->total - fen_sum(last->tree, to % DAY_BLOCK + 1);
+    return sum;
+}
+
+/* room for e's day and category, so day_totals_apply never allocates */
+static int day_totals_reserve(ExpenseDB *db, const Expense *e) {
+    DayTotals *t = &db->days;
+    int d = key_to_day(e->date_key);
+    if (d < 0) return 1;
+    if (e->cat_id >= t->ncat) {
+        int n = t->ncat ? t->ncat : 8;
+        while (n <= e->cat_id) n *= 2;
+        DaySeries *p = realloc(t->by_cat, (size_t)n * sizeof *p);
+        if (!p) return 0;
+        memset(p + t->ncat, 0, (size_t)(n - t->ncat) * sizeof *p);
+        t->by_cat = p;
+        t->ncat = n;
+    }
+    return day_series_block(&t->all, d) && day_series_block(&t->by_cat[e->cat_id], d);
+}
+
+/* sign is +1 when a row appears, -1 when it goes away */
+static void day_totals_apply(ExpenseDB *db, const Expense *e, int sign) {
+    DayTotals *t = &db->days;
+    int d = key_to_day(e->date_key);
+    if (d < 0) return;
+    day_series_add(&t->all, d, sign * e->amount);
+    if (e->cat_id < t->ncat) day_series_add(&t->by_cat[e->cat_id], d, sign * e->amount);
+}
+
+static void day_series_build(DaySeries *s) {
+    for (int i = 0; i < s->count; ++i) fen_build(s->blocks[i].tree, DAY_BLOCK);
+    day_series_outer(s);
+}
+
+/* one pass filling in day values of the blocks in use, then O(days) builds */
+static int day_totals_rebuild(ExpenseDB *db) {
+    DayTotals *t = &db->days;
+    day_totals_free(t);
+    t->ncat = db->cats.count;
+    t->by_cat = calloc((size_t)(t->ncat ? t->ncat : 1), sizeof *t->by_cat);
+    if (!t->by_cat) { t->ncat = 0; return 0; }
+    for (int i = 0; i < db->size; ++i) {
+        const Expense *e = &db->arr[i];
+        int d = ROW_DEAD(e) ? -1 : key_to_day(e->date_key);
+        if (d < 0) continue;
+        DayBlock *a = day_series_block(&t->all, d), *c = a ? day_series_block(&t->by_cat[e->cat_id], d) : NULL;
+        if (!c) {
+            day_totals_free(t);
+            return 0;
+        }
+        a->tree[d % DAY_BLOCK + 1] += e->amount;
+        a->total += e->amount;
+        c->tree[d % DAY_BLOCK + 1] += e->amount;
+        c->total += e->amount;
+    }
+    day_series_build(&t->all);
+    for (int c = 0; c < t->ncat; ++c) day_series_build(&t->by_cat[c]);
+    return 1;
+}
+
+/* sum over day numbers from..to of one series */
+static long long day_totals_range(const DayTotals *t, int cat_id, int from, int to) {
+    if (cat_id < 0) return day_series_range(&t->all, from, to);
+    return cat_id < t->ncat ? day_series_range(&t->by_cat[cat_id], from, to) : 0;
+}
+
+static unsigned rollup_hash(int ym, int cat_id) {
+    return hash_int((unsigned)ym * 2654435761u + (unsigned)(cat_id + 1));
+}
+
+static unsigned rollup_slot(const RollupTable *t, int ym, int cat_id) {
+    unsigned mask = (unsigned)t->hash_cap - 1;
+    unsigned h = rollup_hash(ym, cat_id) & mask;
+    while (t->hash[h] != -1 && (t->items[t->hash[h]].ym != ym || t->items[t->hash[h]].cat_id != cat_id))
+        h = (h + 1) & mask;
+    return h;
+}
+
+static const MonthRollup *rollup_find(const ExpenseDB *db, int ym, int cat_id) {
+    if (db->months.hash_cap == 0) return NULL;
+    int i = db->months.hash[rollup_slot(&db->months, ym, cat_id)];
+    return i == -1 ? NULL : &db->months.items[i];
+}
+
+/* room for `extra` new buckets, so rollup_apply itself never allocates */
+static int rollup_reserve(RollupTable *t, int extra) {
+    int need = t->count + extra;
+    if (need > t->capacity) {
+        int newcap = t->capacity == 0 ? 64 : t->capacity;
+        while (newcap < need) newcap *= 2;
+        MonthRollup *tmp = realloc(t->items, (size_t)newcap * sizeof(MonthRollup));
+        if (!tmp) return 0;
+        t->items = tmp;
+        t->capacity = newcap;
+    }
+    if (need * 2 > t->hash_cap) {
+        int cap = 64;
+        while (cap < need * 2) cap *= 2;
+        int *h = malloc((size_t)cap * sizeof(int));
+        if (!h) return 0;
+        free(t->hash);
+        t->hash = h;
+        t->hash_cap = cap;
+        for (int i = 0; i < cap; ++i) h[i] = -1;
+        for (int i = 0; i < t->count; ++i)
+            h[rollup_slot(t, t->items[i].ym, t->items[i].cat_id)] = i;
+    }
+    return 1;
+}
+
+static void rollup_bump(RollupTable *t, int ym, int cat_id, int day, long long amount, int sign) {
+    unsigned h = rollup_slot(t, ym, cat_id);
+    if (t->hash[h] == -1) {
+        MonthRollup *m = &t->items[t->count];
+        memset(m, 0, sizeof *m);
+        m->ym = ym;
+        m->cat_id = cat_id;
+        t->hash[h] = t->count++;
+    }
+    MonthRollup *m = &t->items[t->hash[h]];
+    m->count += sign;
+    m->total += sign * amount;
+    m->day_rows[day] += sign;
+    if (m->day_rows[day]) m->active_days |= 1u << day;
+    else m->active_days &= ~(1u << day);
+}
+
+/* sign is +1 when a row appears, -1 when it goes away */
+static void rollup_apply(ExpenseDB *db, const Expense *e, int sign) {
+    if (e->date_key < 0) return;
+    int ym = e->date_key / 100, day = e->date_key % 100;
+    if (day < 1 || day > 31) return;
+    rollup_bump(&db->months, ym, -1, day, e->amount, sign);
+    rollup_bump(&db->months, ym, e->cat_id, day, e->amount, sign);
+}
+
+static int rollup_rebuild(ExpenseDB *db) {
+    db->months.count = 0;
+    for (int i = 0; i < db->months.hash_cap; ++i) db->months.hash[i] = -1;
+    for (int i = 0; i < db->size; ++i) {
+        if (ROW_DEAD(&db->arr[i])) continue;
+        if (!rollup_reserve(&db->months, 2)) return 0;
+        rollup_apply(db, &db->arr[i], +1);
+    }
+    return day_totals_rebuild(db);
+}
+
+/* ---- trigram index over descriptions (ASCII case folded) ---- */
+
+static unsigned char fold_ascii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : c;
+}
+
+static unsigned trigram_at(const char *s) {
+    return (unsigned)fold_ascii((unsigned char)s[0]) << 16 |
+           (unsigned)fold_ascii((unsigned char)s[1]) << 8 |
+           (unsigned)fold_ascii((unsigned char)s[2]);
+}
+
+static const TrigramList *text_list(const TextIndex *t, unsigned key) {
+    if (t->cap == 0) return NULL;
+    unsigned mask = (unsigned)t->cap - 1, h = hash_int(key) & mask;
+    while (t->lists[h].key && t->lists[h].key != key) h = (h + 1) & mask;
+    return t->lists[h].key ? &t->lists[h] : NULL;
+}
+
+static TrigramList *text_list_insert(TextIndex *t, unsigned key) {
+    if ((t->count + 1) * 2 > t->cap) {
+        int cap = t->cap ? t->cap * 2 : 1024;
+        TrigramList *nl = calloc((size_t)cap, sizeof(TrigramList));
+        if (!nl) return NULL;
+        for (int i = 0; i < t->cap; ++i) {
+            if (!t->lists[i].key) continue;
+            unsigned h = hash_int(t->lists[i].key) & (unsigned)(cap - 1);
+            while (nl[h].key) h = (h + 1) & (unsigned)(cap - 1);
+            nl[h] = t->lists[i];
+        }
+        free(t->lists);
+        t->lists = nl;
+        t->cap = cap;
+    }
+    unsigned mask = (unsigned)t->cap - 1, h = hash_int(key) & mask;
+    while (t->lists[h].key && t->lists[h].key != key) h = (h + 1) & mask;
+    if (!t->lists[h].key) { t->lists[h].key = key; t->count++; }
+    return &t->lists[h];
+}
+
+static int text_index_row(ExpenseDB *db, int slot) {
+    const char *s = expense_description(db, &db->arr[slot]);
+    size_t n = strlen(s);
+    for (size_t i = 0; i + 3 <= n; ++i) {
+        TrigramList *l = text_list_insert(&db->text, trigram_at(s + i));
+        if (!l) return 0;
+        if (l->len && l->slots[l->len - 1] == slot) continue;
+        if (l->len == l->cap) {
+            int cap = l->cap ? l->cap * 2 : 4;
+            int *tmp = realloc(l->slots, (size_t)cap * sizeof(int));
+            if (!tmp) return 0;
+            l->slots = tmp;
+            l->cap = cap;
+        }
+        l->slots[l->len++] = slot;
+    }
+    return 1;
+}
+
+/* slot numbers change on compaction, so the index is rebuilt then;
+   running out of memory just turns the index off */
+static int text_index_rebuild(ExpenseDB *db) {
+    text_index_free(&db->text);
+    if (!(db->search_flags & SEARCH_TEXT_INDEX)) return 1;
+    for (int i = 0; i < db->size; ++i) {
+        if (ROW_DEAD(&db->arr[i])) continue;
+        if (!text_index_row(db, i)) {
+            text_index_free(&db->text);
+            db->search_flags &= ~SEARCH_TEXT_INDEX;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* takes effect on the next save; every shard is rewritten in the new encoding */
+int db_set_encoding(ExpenseDB *db, int encoding) {
+    if (encoding < ENCODING_COLUMNS || encoding > ENCODING_PACKED_LZ) return 0;
+    if (encoding != db->encoding) db->shards.all_dirty = 1;
+    db->encoding = encoding;
+    return 1;
+}
+
+int db_set_search_flags(ExpenseDB *db, int flags) {
+    int had = db->search_flags & SEARCH_TEXT_INDEX;
+    db->search_flags = flags;
+    if (had != (flags & SEARCH_TEXT_INDEX)) return text_index_rebuild(db);
+    return 1;
+}
+
+/* e already carries its final id; the date key is derived here */
+static void db_append_row(ExpenseDB *db, const Expense *e) {
+    int slot = db->size;
+    if (e != &db->arr[slot]) db->arr[slot] = *e;
+    db->arr[slot].date_key = date_to_key(e->date);
+    id_index_put(db, slot);
+    if (db->by_date_sorted) {
+        /* new id is the largest, so it goes after every row with the same key */
+        int pos = date_lower_bound(db, db->arr[slot].date_key + 1);
+        size_t tail = (size_t)(slot - pos);
+        memmove(db->by_date + pos + 1, db->by_date + pos, tail * sizeof(int));
+        memmove(db->hot.amount + pos + 1, db->hot.amount + pos, tail * sizeof(long long));
+        memmove(db->hot.key + pos + 1, db->hot.key + pos, tail * sizeof(int));
+        memmove(db->hot.cat + pos + 1, db->hot.cat + pos, tail * sizeof(int));
+        db->by_date[pos] = slot;
+        hot_set(db, pos, slot);
+    } else {
+        db->by_date[slot] = slot;
+        hot_set(db, slot, slot);
+    }
+    db->size++;
+    db->live++;
+    db->cats.rows[e->cat_id]++;
+    shard_touch(db, &db->arr[slot]);
+    if ((db->search_flags & SEARCH_TEXT_INDEX) && !text_index_row(db, slot)) {
+        text_index_free(&db->text);
+        db->search_flags &= ~SEARCH_TEXT_INDEX;
+    }
+}
+
+static int add_row(ExpenseDB *db, Expense e, const char *description) {
+    if (e.cat_id < 0 || e.cat_id >= db->cats.count || !db->cats.names[e.cat_id][0]) return 0;
+    if (!ensure_capacity(db)) return 0;
+    if (!rollup_reserve(&db->months, 2)) return 0;
+    e.date[DATE_LEN-1] = '\0';
+    e.date_key = date_to_key(e.date);
+    if (!day_totals_reserve(db, &e)) return 0;
+    if (!desc_set(db, &e, description ? description : "", description ? strlen(description) : 0)) return 0;
+    e.id = db->next_id++;
+    db_append_row(db, &e);
+    rollup_apply(db, &db->arr[db->size - 1], +1);
+    day_totals_apply(db, &db->arr[db->size - 1], +1);
+    journal_log_add(db, &db->arr[db->size - 1]);
+    journal_commit(db);
+    return 1;
+}
+
+int db_add(ExpenseDB *db, Expense e, const char *description) {
+    STAT_START(t0);
+    int ok = add_row(db, e, description);
+    STAT_STOP(SOP_ADD, t0, ok);
+    return ok;
+}
+
+int db_find_index_by_id(const ExpenseDB *db, int id) {
+    if (id <= 0 || db->id_slots_cap == 0) return -1;
+    unsigned mask = (unsigned)db->id_slots_cap - 1;
+    unsigned h = id_hash(id) & mask;
+    while (db->id_slots[h] != -1) {
+        if (db->arr[db->id_slots[h]].id == id) return db->id_slots[h];
+        h = (h + 1) & mask;
+    }
+    return -1;
+}
+
+/* squeeze out deleted rows, keeping the order of the live ones. The date
+   index scratch is taken before any row moves, so running out of memory
+   returns 0 with the DB as it was. */
+int db_compact(ExpenseDB *db) {
+    if (db->live == db->size) return 1;
+    STAT_START(t0);
+    KeySlot *scratch = date_index_scratch(db->live);
+    if (!scratch) return 0;
+    int n = db->size, w = 0;
+    for (int i = 0; i < db->size; ++i) {
+        if (ROW_DEAD(&db->arr[i])) continue;
+        if (w != i) db->arr[w] = db->arr[i];
+        w++;
+    }
+    db->size = w;
+    desc_compact(db);
+    /* fewer rows than before, so the id table is rehashed where it is */
+    int ok = id_index_rebuild(db, db->live);
+    date_index_sort(db, scratch);
+    free(scratch);
+    text_index_rebuild(db);
+    STAT_STOP(SOP_COMPACT, t0, n);
+    return ok;
+}
+
+static int delete_row(ExpenseDB *db, int id) {
+    int idx = db_find_index_by_id(db, id);
+    if (idx < 0) return 0;
+    id_index_remove(db, id);
+    db->cats.rows[db->arr[idx].cat_id]--;
+    rollup_apply(db, &db->arr[idx], -1);
+    day_totals_apply(db, &db->arr[idx], -1);
+    shard_touch(db, &db->arr[idx]);
+    desc_release(db, &db->arr[idx]);
+    int pos = date_pos(db, idx);
+    if (pos >= 0) db->hot.cat[pos] = -1;
+    db->arr[idx].id = 0;
+    db->live--;
+    journal_log_delete(db, id);
+    int dead = db->size - db->live;
+    /* the row is gone either way; a compaction short of memory is retried
+       on a later delete or save */
+    if (dead >= COMPACT_MIN_DEAD && dead * 4 >= db->size) (void)db_compact(db);
+    journal_commit(db);
+    return 1;
+}
+
+int db_delete_by_id(ExpenseDB *db, int id) {
+    STAT_START(t0);
+    int ok = delete_row(db, id);
+    STAT_STOP(SOP_DELETE, t0, ok);
+    return ok;
+}
+
+void db_list(const ExpenseDB *db) {
+    if (db->live == 0) { puts("No expenses recorded."); return; }
+    STAT_START(t0);
+    printf("ID  Date       Amount    Category        Description\n");
+    printf("-------------------------------------------------------------------\n");
+    for (int i = 0; i < db->size; ++i) {
+        const Expense *e = &db->arr[i];
+        if (ROW_DEAD(e)) continue;
+        char amt[AMOUNT_BUF];
+        printf("%-3d %-10s  %8s  %-12s  %.40s\n", e->id, e->date, format_amount(e->amount, amt),
+               category_name(db, e->cat_id), expense_description(db, e));
+    }
+    STAT_STOP(SOP_LIST, t0, db->size);
+}
+
+/* one bucketed pass: count rows per category, then place slots by offset */
+void db_list_grouped_to(FILE *out, const ExpenseDB *db) {
+    if (db->live == 0) { fputs("No expenses recorded.\n", out); return; }
+    STAT_START(t0);
+    AggGroup *groups;
+    int ng = db_aggregate(db, GROUP_CATEGORY, &groups);
+    if (ng < 0) return;
+    int nc = db->cats.count;
+    int *start = calloc((size_t)nc + 1, sizeof(int));
+    int *order = malloc((size_t)db->live * sizeof(int));
+    if (!start || !order) { free(start); free(order); free(groups); return; }
+    for (int g = 0; g < ng; ++g) start[groups[g].cat_id + 1] = groups[g].count;
+    for (int c = 0; c < nc; ++c) start[c + 1] += start[c];
+    int *fill = malloc((size_t)nc * sizeof(int));
+    if (!fill) { free(start); free(order); free(groups); return; }
+    memcpy(fill, start, (size_t)nc * sizeof(int));
+    for (int i = 0; i < db->size; ++i)
+        if (!ROW_DEAD(&db->arr[i])) order[fill[db->arr[i].cat_id]++] = i;
+
+    for (int g = 0; g < ng; ++g) {
+        int ci = groups[g].cat_id;
+        char amt[AMOUNT_BUF];
+        if (groups[g].sum <= 0) continue;
+        fprintf(out, "\n%s : %s\n", db->cats.names[ci], format_amount(groups[g].sum, amt));
+        for (int p = start[ci]; p < start[ci + 1]; ++p) {
+            const Expense *e = &db->arr[order[p]];
+            fprintf(out, "   id %-3d  %s  %8s  %s\n", e->id, e->date, format_amount(e->amount, amt),
+                    expense_description(db, e));
+        }
+    }
+    free(fill);
+    free(start);
+    free(order);
+    free(groups);
+    STAT_STOP(SOP_LIST_GROUPED, t0, db->size);
+}
+
+void db_list_grouped(const ExpenseDB *db) {
+    db_list_grouped_to(stdout, db);
+}
+
+
+/* record layout of v1 data/expenses.bin (the original in-memory Expense) */
+#define V1_DESCRIPTION_LEN 128
+typedef struct {
+    int id;
+    char date[DATE_LEN];
+    double amount;          /* converted to cents on load */
+    char category[CAT_LEN];
+    char description[V1_DESCRIPTION_LEN];
+} DiskExpense;
+
+#define IO_BATCH 1024
+
+/* v2 layout: header, section table, then 8-byte aligned sections. Each
+   column is a plain native array so a mapped file can be read in place.
+   Version 3 stores amounts as int64 cents; version 2 files (doubles) still
+   load, and older builds refuse version 3 rather than misread it. */
+#define DB_MAGIC "EXPDB\0v2"
+#define DB_VERSION 3
+#define DB_VERSION_DOUBLES 2
+#define DB_ENDIAN_MARK 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;        /* DB_ENDIAN_MARK in the writer's byte order */
+    uint32_t header_size;   /* sizeof(DiskHeader); section table follows */
+    uint32_t nsections;
+    int64_t rows;
+    int32_t next_id;
+    int32_t ncat;           /* category slots, removed ones are empty names */
+    uint64_t journal_seq;   /* last journal record folded in, 0 = none */
+    uint32_t encoding;      /* ENCODING_*; older files have 0 = columns */
+    uint32_t pad;
+    uint64_t reserved[2];
+} DiskHeader;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t elem_size;
+    uint64_t offset;        /* from start of file */
+    uint64_t size;          /* bytes */
+} DiskSection;
+
+enum {
+    SEC_CATEGORIES = 1,     /* ncat x CAT_LEN names */
+    SEC_IDS,                /* int32 */
+    SEC_DATE_KEYS,          /* int32 YYYYMMDD or -1 */
+    SEC_AMOUNTS,            /* int64 cents (double in version 2) */
+    SEC_CAT_IDS,            /* int32 index into SEC_CATEGORIES */
+    SEC_DESC_OFFSETS,       /* uint64 x rows+1 into SEC_DESC_HEAP */
+    SEC_DESC_HEAP,          /* descriptions, no terminators */
+    SEC_DATE_TEXT,          /* DiskDate for dates that aren't canonical DD-MM-YYYY */
+    SEC_BLOCKS,             /* PackBlockHead + payload, repeated (packed encodings) */
+    SEC_PAGES,              /* DiskPage per PACK_BLOCK_ROWS rows, for lazy readers */
+    SEC_COUNT = SEC_PAGES
+};
+
+#define SEC_MIN SEC_DATE_TEXT   /* files from before SEC_BLOCKS have this many */
+
+/* packed encodings replace the fixed-width columns with row blocks */
+typedef struct {
+    uint32_t rows;
+    uint32_t codec;         /* CODEC_* */
+    uint32_t raw_len;       /* pack_rows output */
+    uint32_t stored_len;    /* bytes that follow */
+} PackBlockHead;
+
+typedef struct {
+    int32_t row;
+    char date[12];
+} DiskDate;
+
+/* what a page of rows holds, so a lazy reader can skip it undecoded */
+typedef struct {
+    uint64_t offset;        /* packed: its PackBlockHead; columns: 0 */
+    int32_t rows;
+    int32_t min_id, max_id;
+    int32_t min_key, max_key;   /* dated rows only; min > max when none */
+    uint32_t pad;
+    uint64_t cat_mask;      /* bit c % 64 set when category c occurs */
+} DiskPage;
+
+static void page_init(DiskPage *p) {
+    memset(p, 0, sizeof *p);
+    p->min_id = INT32_MAX;
+    p->min_key = INT32_MAX;
+    p->max_key = INT32_MIN;
+}
+
+static void page_add(DiskPage *p, const Expense *e) {
+    p->rows++;
+    if (e->id < p->min_id) p->min_id = e->id;
+    if (e->id > p->max_id) p->max_id = e->id;
+    if (e->date_key > 0) {
+        if (e->date_key < p->min_key) p->min_key = e->date_key;
+        if (e->date_key > p->max_key) p->max_key = e->date_key;
+    }
+    p->cat_mask |= 1ull << (e->cat_id & 63);
+}
+
+static void key_to_date(int key, char *out) {
+    int y = key / 10000, m = key / 100 % 100, d = key % 100;
+    out[0] = (char)('0' + d / 10); out[1] = (char)('0' + d % 10); out[2] = '-';
+    out[3] = (char)('0' + m / 10); out[4] = (char)('0' + m % 10); out[5] = '-';
+    out[6] = (char)('0' + y / 1000); out[7] = (char)('0' + y / 100 % 10);
+    out[8] = (char)('0' + y / 10 % 10); out[9] = (char)('0' + y % 10);
+    out[10] = '\0';
+}
+
+/* date keys only round-trip when the text was canonical */
+static int date_is_canonical(const Expense *e) {
+    char buf[DATE_LEN];
+    if (e->date_key < 10000101 || e->date_key > 99999999) return 0;
+    key_to_date(e->date_key, buf);
+    return strcmp(buf, e->date) == 0;
+}
+
+static int write_pad(FILE *f, uint64_t *pos, uint64_t to) {
+    static const char zero[8];
+    while (*pos < to) {
+        size_t n = to - *pos < 8 ? (size_t)(to - *pos) : 8;
+        if (fwrite(zero, 1, n, f) != n) return 0;
+        *pos += n;
+    }
+    return 1;
+}
+
+/* rows lists the slots to write; NULL means slots 0..nrows-1 */
+#define ROW_AT(rows, i) ((rows) ? (rows)[i] : (i))
+
+static int write_column(FILE *f, const ExpenseDB *db, const int *rows, int nrows, uint32_t kind) {
+    unsigned char buf[IO_BATCH * 8];
+    size_t elem = kind == SEC_AMOUNTS || kind == SEC_DESC_OFFSETS ? 8 : 4;
+    uint64_t heap = 0;
+    for (int i = 0; i < nrows; i += IO_BATCH) {
+        int n = nrows - i < IO_BATCH ? nrows - i : IO_BATCH;
+        for (int j = 0; j < n; ++j) {
+            const Expense *e = &db->arr[ROW_AT(rows, i + j)];
+            unsigned char *o = buf + (size_t)j * elem;
+            int32_t v = 0;
+            switch (kind) {
+            case SEC_IDS: v = e->id; break;
+            case SEC_DATE_KEYS: v = e->date_key; break;
+            case SEC_CAT_IDS: v = e->cat_id; break;
+            case SEC_AMOUNTS: memcpy(o, &e->amount, 8); continue;
+            case SEC_DESC_OFFSETS: memcpy(o, &heap, 8); heap += e->desc_len; continue;
+            }
+            memcpy(o, &v, 4);
+        }
+        if (fwrite(buf, elem, (size_t)n, f) != (size_t)n) return 0;
+    }
+    if (kind == SEC_DESC_OFFSETS && fwrite(&heap, 8, 1, f) != 1) return 0;
+    return 1;
+}
+
+static int write_sections(FILE *f, const ExpenseDB *db, const int *rows, int nrows,
+                          const DiskHeader *h, const DiskSection *sec, const DiskPage *pages) {
+    uint64_t pos = 0;
+    if (fwrite(h, sizeof *h, 1, f) != 1) return 0;
+    if (fwrite(sec, sizeof *sec, SEC_COUNT, f) != SEC_COUNT) return 0;
+    pos = sizeof *h + SEC_COUNT * sizeof *sec;
+    for (int k = 0; k < SEC_COUNT; ++k) {
+        if (!write_pad(f, &pos, sec[k].offset)) return 0;
+        if (sec[k].size == 0) continue; /* also blocks and their pages, written last */
+        switch (sec[k].kind) {
+        case SEC_CATEGORIES:
+            if (h->ncat && fwrite(db->cats.names, CAT_LEN, (size_t)h->ncat, f) != (size_t)h->ncat) return 0;
+            break;
+        case SEC_DESC_HEAP:
+            for (int i = 0; i < nrows; ++i) {
+                const Expense *e = &db->arr[ROW_AT(rows, i)];
+                size_t n = e->desc_len;
+                if (n && fwrite(expense_description(db, e), 1, n, f) != n) return 0;
+            }
+            break;
+        case SEC_DATE_TEXT:
+            for (int i = 0; i < nrows; ++i) {
+                const Expense *e = &db->arr[ROW_AT(rows, i)];
+                if (date_is_canonical(e)) continue;
+                DiskDate d;
+                memset(&d, 0, sizeof d);
+                d.row = i;
+                memcpy(d.date, e->date, DATE_LEN);
+                if (fwrite(&d, sizeof d, 1, f) != 1) return 0;
+            }
+            break;
+        case SEC_PAGES:
+            if (fwrite(pages, 1, (size_t)sec[k].size, f) != sec[k].size) return 0;
+            break;
+        default:
+            if (!write_column(f, db, rows, nrows, sec[k].kind)) return 0;
+        }
+        pos += sec[k].size;
+    }
+    return 1;
+}
+
+/* streams the rows as packed blocks from file offset base, noting each
+   block's offset in pages; returns the bytes written, or 0 */
+static uint64_t write_blocks(FILE *f, const ExpenseDB *db, const int *rows, int nrows, int codec_id,
+                             uint64_t base, DiskPage *pages) {
+    const BlockCodec *codec = pack_codec(codec_id);
+    size_t raw_cap = pack_bound(PACK_BLOCK_ROWS);
+    unsigned char *raw = malloc(raw_cap);
+    unsigned char *packed = malloc(codec->bound(raw_cap));
+    uint64_t total = 0;
+    int ok = raw && packed;
+    for (int i = 0; ok && i < nrows; i += PACK_BLOCK_ROWS) {
+        int n = nrows - i < PACK_BLOCK_ROWS ? nrows - i : PACK_BLOCK_ROWS;
+        PackBlockHead bh;
+        bh.rows = (uint32_t)n;
+        bh.raw_len = (uint32_t)pack_rows(db, rows, i, n, raw);
+        bh.codec = CODEC_NONE;
+        bh.stored_len = bh.raw_len;
+        const unsigned char *out = raw;
+        if (codec_id != CODEC_NONE) {
+            size_t c = codec->compress(raw, bh.raw_len, packed);
+            if (c && c < bh.raw_len) { bh.codec = (uint32_t)codec_id; bh.stored_len = (uint32_t)c; out = packed; }
+        }
+        pages[i / PACK_BLOCK_ROWS].offset = base + total;
+        ok = fwrite(&bh, sizeof bh, 1, f) == 1 && fwrite(out, 1, bh.stored_len, f) == bh.stored_len;
+        total += sizeof bh + bh.stored_len;
+    }
+    free(raw);
+    free(packed);
+    return ok ? total : 0;
+}
+
+static FILE *open_temp(const char *filename, char *tmpname, size_t cap) {
+    if (strlen(filename) + 5 > cap) return NULL;
+    sprintf(tmpname, "%s.tmp", filename);
+    return fopen(tmpname, "wb");
+}
+
+/* moves a finished temp file over filename, or discards it */
+static int commit_temp(const char *tmpname, const char *filename, int ok) {
+#ifdef _WIN32
+    if (ok) remove(filename);
+#endif
+    if (!ok || rename(tmpname, filename) != 0) { remove(tmpname); return 0; }
+    return 1;
+}
+
+/* writes the given rows as a v2 file. Category ids are stored as they are;
+   ncat is how many category names to include (0 when kept elsewhere). The
+   file is written beside the old one and swapped in, so a crash leaves one
+   intact. */
+static int write_v2(const ExpenseDB *db, const char *filename, const int *rows, int nrows, int ncat) {
+    uint64_t n = (uint64_t)nrows, heap = 0, odd_dates = 0;
+    int npages = (nrows + PACK_BLOCK_ROWS - 1) / PACK_BLOCK_ROWS;
+    DiskPage *pages = malloc((size_t)(npages ? npages : 1) * sizeof *pages);
+    if (!pages) return 0;
+    for (int i = 0; i < nrows; ++i) {
+        const Expense *e = &db->arr[ROW_AT(rows, i)];
+        heap += e->desc_len;
+        if (!date_is_canonical(e)) odd_dates++;
+        if (i % PACK_BLOCK_ROWS == 0) page_init(&pages[i / PACK_BLOCK_ROWS]);
+        page_add(&pages[i / PACK_BLOCK_ROWS], e);
+    }
+
+    DiskHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, DB_MAGIC, 8);
+    h.version = DB_VERSION;
+    h.endian = DB_ENDIAN_MARK;
+    h.header_size = sizeof h;
+    h.nsections = SEC_COUNT;
+    h.rows = (int64_t)n;
+    h.next_id = db->next_id;
+    h.ncat = ncat;
+    h.journal_seq = db->journal_seq;
+    h.encoding = (uint32_t)db->encoding;
+    int packed = db->encoding != ENCODING_COLUMNS;
+
+    /* packed files leave the columns empty; the block section, and the
+       pages that point into it, are placed once the blocks are written */
+    DiskSection sec[SEC_COUNT];
+    const uint64_t sizes[SEC_COUNT] = {
+        (uint64_t)ncat * CAT_LEN, packed ? 0 : n * 4, packed ? 0 : n * 4, packed ? 0 : n * 8,
+        packed ? 0 : n * 4, packed ? 0 : (n + 1) * 8, packed ? 0 : heap,
+        odd_dates * sizeof(DiskDate), 0, packed ? 0 : (uint64_t)npages * sizeof(DiskPage)
+    };
+    const uint32_t elems[SEC_COUNT] = { CAT_LEN, 4, 4, 8, 4, 8, 1, sizeof(DiskDate), 1, sizeof(DiskPage) };
+    uint64_t off = sizeof h + sizeof sec, end;
+    for (int k = 0; k < SEC_COUNT; ++k) {
+        off = (off + 7) & ~(uint64_t)7;
+        sec[k].kind = (uint32_t)(k + 1);
+        sec[k].elem_size = elems[k];
+        sec[k].offset = off;
+        sec[k].size = sizes[k];
+        off += sizes[k];
+    }
+    end = off;
+
+    char tmpname[512];
+    FILE *f = open_temp(filename, tmpname, sizeof tmpname);
+    if (!f) { free(pages); return 0; }
+    int ok = write_sections(f, db, rows, nrows, &h, sec, pages);
+    if (ok && packed) {
+        int codec = db->encoding == ENCODING_PACKED_LZ ? CODEC_LZ : CODEC_NONE;
+        DiskSection *blocks = &sec[SEC_BLOCKS - 1], *pg = &sec[SEC_PAGES - 1];
+        blocks->size = write_blocks(f, db, rows, nrows, codec, blocks->offset, pages);
+        if (nrows && !blocks->size) ok = 0;
+        uint64_t pos = blocks->offset + blocks->size;
+        pg->offset = (pos + 7) & ~(uint64_t)7;
+        pg->size = (uint64_t)npages * sizeof(DiskPage);
+        if (ok && (!write_pad(f, &pos, pg->offset) || fwrite(pages, 1, (size_t)pg->size, f) != pg->size)) ok = 0;
+        end = pg->offset + pg->size;
+        if (ok && (fseek(f, (long)sizeof h, SEEK_SET) != 0 || fwrite(sec, sizeof sec, 1, f) != 1)) ok = 0;
+    }
+    free(pages);
+    if (fclose(f) != 0) ok = 0;
+    if (ok) STAT_COUNT(bytes_written, end);
+    return commit_temp(tmpname, filename, ok);
+}
+
+/* copies what a save writes, so it can be written while db keeps changing:
+   the live rows and category names are copied, the text chunks shared */
+int db_snapshot(const ExpenseDB *db, ExpenseDB *snap) {
+    db_init_empty(snap);
+    snap->arr = malloc((size_t)(db->live ? db->live : 1) * sizeof(Expense));
+    snap->cats.names = malloc((size_t)(db->cats.count ? db->cats.count : 1) * CAT_LEN);
+    snap->descs.chunks = malloc((size_t)(db->descs.count ? db->descs.count : 1) * sizeof(char *));
+    if (!snap->arr || !snap->cats.names || !snap->descs.chunks) { db_free(snap); return 0; }
+    for (int i = 0; i < db->size; ++i)
+        if (!ROW_DEAD(&db->arr[i])) snap->arr[snap->size++] = db->arr[i];
+    snap->live = snap->capacity = snap->size;
+    memcpy(snap->cats.names, db->cats.names, (size_t)db->cats.count * CAT_LEN);
+    snap->cats.count = snap->cats.capacity = db->cats.count;
+    for (int i = 0; i < db->descs.count; ++i) {
+        snap->descs.chunks[i] = db->descs.chunks[i];
+        chunk_share(snap->descs.chunks[i]);
+    }
+    snap->descs.count = snap->descs.cap = db->descs.count;
+    snap->next_id = db->next_id;
+    snap->journal_seq = db->journal_seq;
+    snap->encoding = db->encoding;
+    return 1;
+}
+
+/* writes a db_snapshot copy; touches nothing else, so it can run on
+   another thread. The journal is left for the caller to reset. */
+int db_save_snapshot(const ExpenseDB *snap, const char *filename) {
+    STAT_START(t0);
+    ensure_data_dir();
+    int ok = write_v2(snap, filename, NULL, snap->size, snap->cats.count);
+    STAT_STOP(SOP_SAVE_SNAPSHOT, t0, ok ? snap->size : 0);
+    return ok;
+}
+
+int db_save_binary(ExpenseDB *db, const char *filename) {
+    STAT_START(t0);
+    if (!db_compact(db)) return 0;
+    ensure_data_dir();
+    /* categories keep their ids; removed ones are written as empty names */
+    int ok = write_v2(db, filename, NULL, db->size, db->cats.count);
+    /* everything logged so far is in the snapshot now */
+    if (ok && db->journal && strcmp(filename, db->journal->snapshot) == 0) journal_reset(db->journal);
+    STAT_STOP(SOP_SAVE, t0, ok ? db->size : 0);
+    return ok;
+}
+
+static int load_v1(ExpenseDB *tmp, FILE *f, int *next_id_out) {
+    int n, next_id, ncat;
+    if (fread(&n, sizeof(int), 1, f) != 1) return 0;
+    if (fread(&next_id, sizeof(int), 1, f) != 1) return 0;
+    if (fread(&ncat, sizeof(int), 1, f) != 1) return 0;
+    if (n < 0 || ncat < 0) return 0;
+
+    char name[CAT_LEN];
+    for (int i = 0; i < ncat; ++i) {
+        if (fread(name, CAT_LEN, 1, f) != 1) return 0;
+        name[CAT_LEN-1] = '\0';
+        if (name[0] && category_intern(tmp, name) < 0) return 0;
+    }
+    if (n > 0 && !db_reserve(tmp, n)) return 0;
+    DiskExpense *buf = malloc(IO_BATCH * sizeof(DiskExpense));
+    if (!buf) return 0;
+    int ok = 1;
+    for (int i = 0; ok && i < n; i += IO_BATCH) {
+        int cnt = n - i < IO_BATCH ? n - i : IO_BATCH;
+        if (fread(buf, sizeof(DiskExpense), (size_t)cnt, f) != (size_t)cnt) { ok = 0; break; }
+        for (int j = 0; j < cnt; ++j) {
+            const DiskExpense *r = &buf[j];
+            if (r->id <= 0) continue;
+            Expense e;
+            e.id = r->id;
+            memcpy(e.date, r->date, DATE_LEN);
+            e.date[DATE_LEN-1] = '\0';
+            e.amount = amount_from_double(r->amount);
+            const char *nul = memchr(r->description, '\0', V1_DESCRIPTION_LEN);
+            size_t len = nul ? (size_t)(nul - r->description) : V1_DESCRIPTION_LEN - 1;
+            if (!desc_set(tmp, &e, r->description, len)) { ok = 0; break; }
+            memcpy(name, r->category, CAT_LEN);
+            name[CAT_LEN-1] = '\0';
+            e.cat_id = category_intern(tmp, name[0] ? name : "Misc");
+            if (e.cat_id < 0) { ok = 0; break; }
+            db_append_row(tmp, &e);
+            if (e.id >= next_id) next_id = e.id + 1;
+        }
+    }
+    free(buf);
+    *next_id_out = next_id;
+    return ok;
+}
+
+/* the section of that kind if it lies inside the file with the expected
+   element size and, unless count is UINT64_MAX, element count */
+static const DiskSection *v2_find(const DiskSection *sec, uint64_t file_size, uint32_t kind,
+                                  uint32_t elem, uint64_t count) {
+    for (int k = 0; k < SEC_COUNT; ++k) {
+        const DiskSection *s = &sec[k];
+        if (s->kind != kind) continue;
+        if (s->elem_size != elem || s->offset % 8 || s->offset > file_size || s->size > file_size - s->offset) return NULL;
+        if (count != UINT64_MAX && s->size != count * elem) return NULL;
+        return s;
+    }
+    return NULL;
+}
+
+/* section bounds are checked once, then the columns are read in place */
+static const void *v2_section(const CsvBuffer *b, const DiskSection *sec, uint32_t kind,
+                              uint32_t elem, uint64_t count) {
+    const DiskSection *s = v2_find(sec, b->size, kind, elem, count);
+    return s ? b->data + s->offset : NULL;
+}
+
+static int v2_header_ok(const DiskHeader *h, uint64_t file_size) {
+    if (memcmp(h->magic, DB_MAGIC, 8) != 0) return 0;
+    if (h->endian != DB_ENDIAN_MARK || (h->version != DB_VERSION && h->version != DB_VERSION_DOUBLES)) return 0;
+    if (h->header_size < sizeof *h || h->nsections < SEC_MIN || h->rows < 0 || h->rows > INT_MAX || h->ncat < 0) return 0;
+    return (uint64_t)h->header_size + (uint64_t)h->nsections * sizeof(DiskSection) <= file_size;
+}
+
+/* sections this build doesn't know are skipped, ones it expects but the
+   file predates read as missing */
+static uint32_t v2_known_sections(const DiskHeader *h, DiskSection *sec) {
+    memset(sec, 0, SEC_COUNT * sizeof *sec);
+    return h->nsections < SEC_COUNT ? h->nsections : SEC_COUNT;
+}
+
+/* checks the header and copies out the section table of a mapped v2 file */
+static int v2_open(const CsvBuffer *b, DiskHeader *h, DiskSection *sec) {
+    if (b->size < sizeof *h) return 0;
+    memcpy(h, b->data, sizeof *h);
+    if (!v2_header_ok(h, b->size)) return 0;
+    memcpy(sec, b->data + h->header_size, v2_known_sections(h, sec) * sizeof *sec);
+    return 1;
+}
+
+/* shared tail of both decoders: e holds the stored fields, and gets its
+   category mapped, its date and description filled in and is appended */
+static int v2_finish_row(ExpenseDB *tmp, Expense *e, const char *desc, size_t desc_len,
+                         const int *cat_map, int ncat, const DiskDate *odd, uint64_t nodd,
+                         uint64_t *o, uint64_t i, int *next_id) {
+    int c = e->cat_id;
+    if (e->id <= 0 || c < 0 || c >= ncat || cat_map[c] < 0) return 0;
+    if (!desc_set(tmp, e, desc, desc_len)) return 0;
+    e->cat_id = cat_map[c];
+    if (e->date_key >= 10000101 && e->date_key <= 99999999) key_to_date(e->date_key, e->date);
+    else e->date[0] = '\0';
+    while (*o < nodd && (uint64_t)odd[*o].row < i) (*o)++;
+    if (*o < nodd && (uint64_t)odd[*o].row == i) {
+        memcpy(e->date, odd[*o].date, DATE_LEN);
+        e->date[DATE_LEN-1] = '\0';
+    }
+    db_append_row(tmp, e);
+    if (e->id >= *next_id) *next_id = e->id + 1;
+    return 1;
+}
+
+static int v2_packed_rows(ExpenseDB *tmp, const CsvBuffer *b, const DiskSection *sec, uint64_t n, int legacy,
+                          const int *cat_map, int ncat, const DiskDate *odd, uint64_t nodd, int *next_id) {
+    const unsigned char *p = v2_section(b, sec, SEC_BLOCKS, 1, UINT64_MAX);
+    if (!p) return 0;
+    const unsigned char *end = p + sec[SEC_BLOCKS - 1].size;
+    size_t raw_cap = pack_bound(PACK_BLOCK_ROWS);
+    unsigned char *scratch = malloc(raw_cap);
+    if (!scratch) return 0;
+    uint64_t row = 0, o = 0;
+    int ok = 1;
+    while (ok && row < n) {
+        PackBlockHead bh;
+        const BlockCodec *codec;
+        if ((size_t)(end - p) < sizeof bh) { ok = 0; break; }
+        memcpy(&bh, p, sizeof bh);
+        p += sizeof bh;
+        if (bh.rows == 0 || bh.rows > PACK_BLOCK_ROWS || bh.rows > n - row || bh.raw_len > raw_cap ||
+            bh.stored_len > (size_t)(end - p) || !(codec = pack_codec((int)bh.codec))) { ok = 0; break; }
+        const unsigned char *raw = p;
+        if (bh.codec != CODEC_NONE) {
+            if (!codec->decompress(p, bh.stored_len, scratch, bh.raw_len)) { ok = 0; break; }
+            raw = scratch;
+        } else if (bh.stored_len != bh.raw_len) { ok = 0; break; }
+        p += bh.stored_len;
+        /* decode straight into the rows about to be appended */
+        const char *text;
+        if (!unpack_rows(raw, bh.raw_len, &tmp->arr[tmp->size], (int)bh.rows, legacy, &text)) { ok = 0; break; }
+        for (uint32_t i = 0; ok && i < bh.rows; ++i, ++row) {
+            Expense *e = &tmp->arr[tmp->size];
+            const char *d = text;
+            text += e->desc_len;
+            ok = v2_finish_row(tmp, e, d, e->desc_len, cat_map, ncat, odd, nodd, &o, row, next_id);
+        }
+    }
+    free(scratch);
+    return ok;
+}
+
+/* appends the file's rows to tmp; cat_map turns the file's ncat category
+   ids into tmp's (-1 = removed) */
+static int v2_rows(ExpenseDB *tmp, const CsvBuffer *b, const DiskHeader *h, const DiskSection *sec,
+                   const int *cat_map, int ncat, int *next_id) {
+    uint64_t n = (uint64_t)h->rows;
+    const DiskDate *odd = v2_section(b, sec, SEC_DATE_TEXT, sizeof(DiskDate), UINT64_MAX);
+    if (!odd) return 0;
+    uint64_t nodd = sec[SEC_DATE_TEXT - 1].size / sizeof(DiskDate);
+    if (n > (uint64_t)(INT_MAX - tmp->size) || !db_reserve(tmp, tmp->size + (int)n)) return 0;
+    tmp->encoding = (int)h->encoding;
+    int legacy = h->version == DB_VERSION_DOUBLES;
+    if (h->encoding != ENCODING_COLUMNS)
+        return v2_packed_rows(tmp, b, sec, n, legacy, cat_map, ncat, odd, nodd, next_id);
+
+    const int32_t *ids = v2_section(b, sec, SEC_IDS, 4, n);
+    const int32_t *keys = v2_section(b, sec, SEC_DATE_KEYS, 4, n);
+    const void *amounts = v2_section(b, sec, SEC_AMOUNTS, 8, n);
+    const int32_t *cat_ids = v2_section(b, sec, SEC_CAT_IDS, 4, n);
+    const uint64_t *doff = v2_section(b, sec, SEC_DESC_OFFSETS, 8, n + 1);
+    const char *heap = v2_section(b, sec, SEC_DESC_HEAP, 1, UINT64_MAX);
+    if (!ids || !keys || !amounts || !cat_ids || !doff || !heap) return 0;
+    uint64_t heap_size = sec[SEC_DESC_HEAP - 1].size, o = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        Expense *e = &tmp->arr[tmp->size];
+        if (doff[i] > doff[i + 1] || doff[i + 1] > heap_size) return 0;
+        e->id = ids[i];
+        e->date_key = keys[i];
+        e->amount = legacy ? amount_from_double(((const double *)amounts)[i]) : ((const int64_t *)amounts)[i];
+        e->cat_id = cat_ids[i];
+        if (!v2_finish_row(tmp, e, heap + doff[i], (size_t)(doff[i + 1] - doff[i]),
+                           cat_map, ncat, odd, nodd, &o, i, next_id)) return 0;
+    }
+    return 1;
+}
+
+static int load_v2(ExpenseDB *tmp, const CsvBuffer *b, int *next_id_out) {
+    DiskHeader h;
+    DiskSection sec[SEC_COUNT];
+    if (!v2_open(b, &h, sec)) return 0;
+    const char (*names)[CAT_LEN] = v2_section(b, sec, SEC_CATEGORIES, CAT_LEN, (uint64_t)h.ncat);
+    if (h.ncat && !names) return 0;
+
+    int *cat_map = malloc((size_t)(h.ncat ? h.ncat : 1) * sizeof(int));
+    if (!cat_map) return 0;
+    char name[CAT_LEN];
+    int ok = 1;
+    for (int i = 0; ok && i < h.ncat; ++i) {
+        memcpy(name, names[i], CAT_LEN);
+        name[CAT_LEN-1] = '\0';
+        cat_map[i] = name[0] ? category_intern(tmp, name) : -1;
+        if (name[0] && cat_map[i] < 0) ok = 0;
+    }
+    *next_id_out = h.next_id;
+    tmp->journal_seq = h.journal_seq;
+    if (ok) ok = v2_rows(tmp, b, &h, sec, cat_map, h.ncat, next_id_out);
+    free(cat_map);
+    return ok;
+}
+
+int db_journal_attach(ExpenseDB *db, const char *snapshot) {
+    ensure_data_dir();
+    return journal_open(db, snapshot);
+}
+
+/* builds into a scratch DB so a bad file leaves the current one untouched */
+static int load_binary(ExpenseDB *db, const char *filename) {
+    CsvBuffer b;
+    ExpenseDB tmp;
+    int ok = 1, next_id = 1, snapshot = csv_open(&b, filename);
+    if (!snapshot) {
+        /* no snapshot yet: anything since the first run is only in the journal */
+        db_init(&tmp);
+        tmp.by_date_sorted = 0;
+        tmp.encoding = db->encoding;
     } else {
-        *cur = p;
+        db_init_empty(&tmp);
+        tmp.by_date_sorted = 0;
+        tmp.encoding = db->encoding;    /* v2 files carry their own */
+        if (b.size >= 8 && memcmp(b.data, DB_MAGIC, 8) == 0) {
+            ok = load_v2(&tmp, &b, &next_id);
+            csv_close(&b);
+        } else {
+            csv_close(&b);
+            FILE *f = fopen(filename, "rb");
+            ok = f && load_v1(&tmp, f, &next_id);
+            if (f) fclose(f);
+        }
+    }
+    /* replayed adds and deletes update the rollups and day totals in place,
+       so those have to cover the snapshot's rows first */
+    if (ok && !rollup_rebuild(&tmp)) ok = 0;
+    if (ok) {
+        /* changes logged after the snapshot was written */
+        tmp.next_id = next_id;
+        int n = journal_replay(&tmp, filename);
+        if (n < 0 || (!snapshot && n == 0)) ok = 0;
+        next_id = tmp.next_id;
+    }
+    if (ok && !date_index_rebuild(&tmp)) ok = 0;
+    if (!ok) { db_free(&tmp); return 0; }
+    tmp.next_id = next_id;
+    tmp.search_flags = db->search_flags;
+    text_index_rebuild(&tmp);
+    tmp.journal = db->journal;
+    if (tmp.journal && tmp.journal_seq < db->journal_seq) tmp.journal_seq = db->journal_seq;
+    db->journal = NULL;
+    db_free(db);
+    *db = tmp;
+    return 1;
+}
+
+int db_load_binary(ExpenseDB *db, const char *filename) {
+    STAT_START(t0);
+    int ok = load_binary(db, filename);
+    STAT_STOP(SOP_LOAD, t0, ok ? db->size : 0);
+    return ok;
+}
+
+
+/* ---- month-sharded storage: DIR/YYYY-MM.bin per month plus DIR/manifest.bin ----
+   Shards are v2 files without a category table; their category ids index
+   the manifest's table, so renaming a category only rewrites the manifest. */
+
+#define SHARD_MAGIC "EXPSHRD1"
+#define SHARD_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    int32_t next_id;
+    int32_t ncat;           /* category slots, removed ones are empty names */
+    int32_t nshards;
+    uint32_t reserved;
+} ShardManifest;
+
+typedef struct {
+    int32_t ym;             /* YYYYMM, 0 = rows without a usable date */
+    int32_t rows;
+} ShardEntry;
+
+static void shard_path(char *out, size_t cap, const char *dir, int ym) {
+    if (ym == 0) snprintf(out, cap, "%s/undated.bin", dir);
+    else snprintf(out, cap, "%s/%04d-%02d.bin", dir, ym / 100 % 10000, ym % 100);
+}
+
+/* *names and *shards are malloc'd by a successful read */
+static int read_manifest(const char *dir, ShardManifest *m, char (**names)[CAT_LEN], ShardEntry **shards) {
+    char path[512];
+    snprintf(path, sizeof path, "%s/manifest.bin", dir);
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    *names = NULL;
+    *shards = NULL;
+    int ok = fread(m, sizeof *m, 1, f) == 1 && memcmp(m->magic, SHARD_MAGIC, 8) == 0 &&
+             m->version == SHARD_VERSION && m->endian == DB_ENDIAN_MARK &&
+             m->ncat >= 0 && m->nshards >= 0 && m->ncat < (1 << 24) && m->nshards < (1 << 24);
+    if (ok) {
+        *names = malloc((size_t)(m->ncat ? m->ncat : 1) * CAT_LEN);
+        *shards = malloc((size_t)(m->nshards ? m->nshards : 1) * sizeof(ShardEntry));
+        ok = *names && *shards &&
+             fread(*names, CAT_LEN, (size_t)m->ncat, f) == (size_t)m->ncat &&
+             fread(*shards, sizeof(ShardEntry), (size_t)m->nshards, f) == (size_t)m->nshards;
+    }
+    fclose(f);
+    if (!ok) { free(*names); free(*shards); *names = NULL; *shards = NULL; }
+    return ok;
+}
+
+static int write_manifest(const ExpenseDB *db, const char *dir, const ShardEntry *shards, int n) {
+    char path[512], tmpname[520];
+    snprintf(path, sizeof path, "%s/manifest.bin", dir);
+    ShardManifest m;
+    memset(&m, 0, sizeof m);
+    memcpy(m.magic, SHARD_MAGIC, 8);
+    m.version = SHARD_VERSION;
+    m.endian = DB_ENDIAN_MARK;
+    m.next_id = db->next_id;
+    m.ncat = db->cats.count;
+    m.nshards = n;
+    FILE *f = open_temp(path, tmpname, sizeof tmpname);
+    if (!f) return 0;
+    int ok = fwrite(&m, sizeof m, 1, f) == 1 &&
+             (m.ncat == 0 || fwrite(db->cats.names, CAT_LEN, (size_t)m.ncat, f) == (size_t)m.ncat) &&
+             (n == 0 || fwrite(shards, sizeof *shards, (size_t)n, f) == (size_t)n);
+    if (fclose(f) != 0) ok = 0;
+    return commit_temp(tmpname, path, ok);
+}
+
+/* appends one shard's rows; cat_map covers ncat manifest category ids */
+static int shard_read(ExpenseDB *db, const char *dir, int ym, const int *cat_map, int ncat, int *next_id) {
+    char path[512];
+    shard_path(path, sizeof path, dir, ym);
+    CsvBuffer b;
+    if (!csv_open(&b, path)) return 0;
+    DiskHeader h;
+    DiskSection sec[SEC_COUNT];
+    int ok = v2_open(&b, &h, sec) && v2_rows(db, &b, &h, sec, cat_map, ncat, next_id);
+    csv_close(&b);
+    return ok;
+}
+
+static int cmp_shard_ym(const void *a, const void *b) {
+    const ShardEntry *x = a, *y = b;
+    return (x->ym > y->ym) - (x->ym < y->ym);
+}
+
+static int shard_listed(const ShardEntry *s, int n, int ym) {
+    for (int i = 0; i < n; ++i) if (s[i].ym == ym) return 1;
+    return 0;
+}
+
+/* rewrites only the months changed since the shards were last loaded or
+   saved, plus the manifest. Months changed outside a loaded window are read
+   back in first so their shard is rewritten whole. */
+static int save_sharded(ExpenseDB *db, const char *dir) {
+    ShardState *st = &db->shards;
+    ensure_data_dir();
+    MKDIR(dir);
+    if (strlen(dir) >= sizeof st->dir) return 0;
+
+    ShardManifest man;
+    char (*names)[CAT_LEN] = NULL;
+    ShardEntry *disk = NULL;
+    int ndisk = read_manifest(dir, &man, &names, &disk) ? man.nshards : 0;
+    free(names);
+    int synced = ndisk > 0 && !st->all_dirty && strcmp(st->dir, dir) == 0;
+
+    int ok = 1;
+    if (synced) {
+        int merged = 0, *cat_map = malloc((size_t)(db->cats.count ? db->cats.count : 1) * sizeof(int));
+        if (!cat_map) ok = 0;
+        for (int i = 0; cat_map && i < db->cats.count; ++i) cat_map[i] = db->cats.names[i][0] ? i : -1;
+        db->by_date_sorted = 0;
+        for (int i = 0; ok && i < ndisk; ++i) {
+            int m = disk[i].ym;
+            if (!month_set_has(&st->dirty, m) || month_set_has(&st->loaded, m)) continue;
+            ok = shard_read(db, dir, m, cat_map, db->cats.count, &db->next_id) && month_set_add(&st->loaded, m);
+            merged = 1;
+        }
+        free(cat_map);
+        if (ok && merged && !rollup_rebuild(db)) ok = 0;
+        if (merged) text_index_rebuild(db);
+    }
+    if (!db_compact(db)) ok = 0;
+    if (ok && !date_index_rebuild(db)) ok = 0;
+
+    /* date order keeps each month contiguous; undated rows go in front */
+    int *order = malloc((size_t)(db->size ? db->size : 1) * sizeof(int));
+    int nmem = 0, w = 0;
+    if (!order) ok = 0;
+    for (int a = 0; order && a < db->size; ++a)
+        if (shard_month(&db->arr[db->by_date[a]]) == 0) order[w++] = db->by_date[a];
+    for (int a = 0; order && a < db->size; ++a) {
+        int m = shard_month(&db->arr[db->by_date[a]]);
+        if (m == 0) continue;
+        if (w == 0 || m != shard_month(&db->arr[order[w - 1]])) nmem++;
+        order[w++] = db->by_date[a];
+    }
+    if (order && w > 0 && shard_month(&db->arr[order[0]]) == 0) nmem++;
+    ShardEntry *out = malloc((size_t)(nmem + ndisk + 1) * sizeof(ShardEntry));
+    if (!out) ok = 0;
+    int nout = 0;
+    char path[512];
+    for (int a = 0; ok && a < db->size; ) {
+        int m = shard_month(&db->arr[order[a]]), b = a + 1;
+        while (b < db->size && shard_month(&db->arr[order[b]]) == m) b++;
+        if (!synced || month_set_has(&st->dirty, m) || !shard_listed(disk, ndisk, m)) {
+            shard_path(path, sizeof path, dir, m);
+            if (!write_v2(db, path, order + a, b - a, 0)) ok = 0;
+        }
+        out[nout].ym = m;
+        out[nout].rows = b - a;
+        nout++;
+        a = b;
+    }
+    /* shards with no rows in memory: keep them unless they were loaded
+       (then every row was deleted) or belong to another database */
+    int kept = 0;
+    for (int i = 0; ok && i < ndisk; ++i) {
+        int m = disk[i].ym;
+        if (shard_listed(out, nmem, m)) continue;
+        if (synced && !month_set_has(&st->loaded, m)) { out[nout++] = disk[i]; kept++; continue; }
+        shard_path(path, sizeof path, dir, m);
+        remove(path);
+    }
+    if (ok) {
+        month_set_clear(&st->loaded);
+        for (int i = 0; i < nmem; ++i)
+            if (!month_set_add(&st->loaded, out[i].ym)) ok = 0;
+        qsort(out, (size_t)nout, sizeof *out, cmp_shard_ym);
+        ok = ok && write_manifest(db, dir, out, nout);
+    }
+    if (ok) {
+        strcpy(st->dir, dir);
+        month_set_clear(&st->dirty);
+        st->all_dirty = 0;
+        st->partial = kept > 0;
+    }
+    free(order);
+    free(out);
+    free(disk);
+    return ok;
+}
+
+int db_save_sharded(ExpenseDB *db, const char *dir) {
+    STAT_START(t0);
+    int ok = save_sharded(db, dir);
+    STAT_STOP(SOP_SAVE_SHARDED, t0, ok ? db->size : 0);
+    return ok;
+}
+
+/* loads the shards whose month lies in [from_month, to_month] (MM-YYYY,
+   either may be NULL for no bound). Rows without a date come along only
+   when no window is given. */
+static int load_sharded(ExpenseDB *db, const char *dir, const char *from_month, const char *to_month) {
+    int from = 0, to = INT_MAX;
+    if (from_month && from_month[0] && (from = month_to_key(from_month)) < 0) return 0;
+    if (to_month && to_month[0] && (to = month_to_key(to_month)) < 0) return 0;
+    if (from) from /= 100;
+    if (to != INT_MAX) to /= 100;
+    int windowed = from != 0 || to != INT_MAX;
+    if (strlen(dir) >= sizeof db->shards.dir) return 0;
+
+    ShardManifest man;
+    char (*names)[CAT_LEN];
+    ShardEntry *disk;
+    if (!read_manifest(dir, &man, &names, &disk)) return 0;
+
+    ExpenseDB tmp;
+    db_init_empty(&tmp);
+    tmp.encoding = db->encoding;
+    tmp.by_date_sorted = 0;
+    int ok = 1, next_id = man.next_id;
+    int *cat_map = malloc((size_t)(man.ncat ? man.ncat : 1) * sizeof(int));
+    if (!cat_map) ok = 0;
+    char name[CAT_LEN];
+    for (int i = 0; ok && i < man.ncat; ++i) {
+        memcpy(name, names[i], CAT_LEN);
+        name[CAT_LEN-1] = '\0';
+        int id = name[0] ? category_intern(&tmp, name) : cat_dict_hole(&tmp.cats);
+        if (id != i) ok = 0; /* ids must line up with what the shards store */
+        cat_map[i] = name[0] ? i : -1;
+    }
+    long long want = 0;
+    for (int i = 0; i < man.nshards; ++i) {
+        int m = disk[i].ym;
+        if (m == 0 ? !windowed : (m >= from && m <= to)) want += disk[i].rows;
+    }
+    if (ok && (want > INT_MAX / 2 || !db_reserve(&tmp, (int)want))) ok = 0;
+    for (int i = 0; ok && i < man.nshards; ++i) {
+        int m = disk[i].ym;
+        if (m == 0 ? windowed : (m < from || m > to)) { tmp.shards.partial = 1; continue; }
+        ok = shard_read(&tmp, dir, m, cat_map, man.ncat, &next_id) && month_set_add(&tmp.shards.loaded, m);
+    }
+    free(cat_map);
+    free(names);
+    free(disk);
+    if (ok && (!date_index_rebuild(&tmp) || !rollup_rebuild(&tmp))) ok = 0;
+    if (!ok) { db_free(&tmp); return 0; }
+    tmp.next_id = next_id;
+    strcpy(tmp.shards.dir, dir);
+    month_set_clear(&tmp.shards.dirty);
+    tmp.search_flags = db->search_flags;
+    text_index_rebuild(&tmp);
+    db_free(db);
+    *db = tmp;
+    return 1;
+}
+
+int db_load_sharded(ExpenseDB *db, const char *dir, const char *from_month, const char *to_month) {
+    STAT_START(t0);
+    int ok = load_sharded(db, dir, from_month, to_month);
+    STAT_STOP(SOP_LOAD_SHARDED, t0, ok ? db->size : 0);
+    return ok;
+}
+
+
+/* ---- lazy, read-only view of a v2 snapshot ----
+   Opening reads the header, category names, odd dates and the page
+   directory. Pages of rows are decoded when a query first needs them and
+   kept in an LRU cache of bounded size; the directory lets queries skip
+   pages that cannot match. */
+
+typedef struct LazyPage {
+    int index;
+    int n;
+    Expense *rows;          /* cat_id indexes the file's names; desc_ref is an offset into text */
+    char *text;             /* descriptions, each NUL-terminated */
+    size_t bytes;           /* charged against the cache budget */
+    struct LazyPage *prev, *next;   /* LRU order, most recent first */
+} LazyPage;
+
+struct LazyDB {
+    FILE *f;
+    uint64_t file_size;
+    DiskHeader h;
+    DiskSection sec[SEC_COUNT];
+    char (*names)[CAT_LEN];
+    DiskDate *odd;
+    uint64_t nodd;
+    DiskPage *pages;
+    int npages;
+    int rebuilt;            /* the file had no page directory; built on open */
+    long journal_bytes;     /* unsaved changes beside the snapshot */
+    LazyPage **resident;    /* by page number, NULL = not cached */
+    LazyPage *head, *tail;
+    int nresident;
+    size_t used, budget;
+    unsigned char *raw, *stored;    /* block buffers */
+    size_t raw_cap, stored_cap;
+    unsigned long long hits, misses, evictions;
+};
+
+static int lazy_read(LazyDB *lz, uint64_t off, void *buf, size_t n) {
+    if (off > lz->file_size || n > lz->file_size - off) return 0;
+    STAT_COUNT(bytes_read, n);
+    return n == 0 || (FSEEK64(lz->f, off, SEEK_SET) == 0 && fread(buf, 1, n, lz->f) == n);
+}
+
+/* a whole small section, read into a new buffer */
+static void *lazy_section(LazyDB *lz, uint32_t kind, uint32_t elem, uint64_t count, uint64_t *bytes) {
+    const DiskSection *s = v2_find(lz->sec, lz->file_size, kind, elem, count);
+    if (!s || s->size > SIZE_MAX - 1) return NULL;
+    void *p = malloc((size_t)s->size + 1);
+    if (p && !lazy_read(lz, s->offset, p, (size_t)s->size)) { free(p); return NULL; }
+    if (bytes) *bytes = s->size;
+    return p;
+}
+
+/* rows [first, first + n) of one fixed-width column */
+static int lazy_column(LazyDB *lz, uint32_t kind, uint32_t elem, uint64_t first, int n, void *out) {
+    uint64_t count = (uint64_t)lz->h.rows + (kind == SEC_DESC_OFFSETS);
+    const DiskSection *s = v2_find(lz->sec, lz->file_size, kind, elem, count);
+    return s && lazy_read(lz, s->offset + first * elem, out, (size_t)n * elem);
+}
+
+/* decodes a columns page; *text gets the descriptions back to back */
+static int lazy_columns_page(LazyDB *lz, uint64_t first, int n, Expense *rows, char **text) {
+    int32_t *v = (int32_t *)lz->raw;
+    uint64_t *off = (uint64_t *)lz->raw;
+    if (!lazy_column(lz, SEC_IDS, 4, first, n, v)) return 0;
+    for (int i = 0; i < n; ++i) rows[i].id = v[i];
+    if (!lazy_column(lz, SEC_DATE_KEYS, 4, first, n, v)) return 0;
+    for (int i = 0; i < n; ++i) rows[i].date_key = v[i];
+    if (!lazy_column(lz, SEC_CAT_IDS, 4, first, n, v)) return 0;
+    for (int i = 0; i < n; ++i) rows[i].cat_id = v[i];
+    if (!lazy_column(lz, SEC_AMOUNTS, 8, first, n, lz->raw)) return 0;
+    for (int i = 0; i < n; ++i) {
+        if (lz->h.version == DB_VERSION_DOUBLES) rows[i].amount = amount_from_double(((const double *)lz->raw)[i]);
+        else rows[i].amount = ((const int64_t *)lz->raw)[i];
+    }
+    if (!lazy_column(lz, SEC_DESC_OFFSETS, 8, first, n + 1, off)) return 0;
+    for (int i = 0; i < n; ++i) {
+        if (off[i] > off[i + 1] || off[i + 1] - off[i] >= DESCRIPTION_LEN) return 0;
+        rows[i].desc_len = (unsigned)(off[i + 1] - off[i]);
+    }
+    const DiskSection *heap = v2_find(lz->sec, lz->file_size, SEC_DESC_HEAP, 1, UINT64_MAX);
+    if (!heap || off[n] > heap->size) return 0;
+    size_t len = (size_t)(off[n] - off[0]);
+    if (!(*text = malloc(len + 1))) return 0;
+    return lazy_read(lz, heap->offset + off[0], *text, len);
+}
+
+static int lazy_block_page(LazyDB *lz, const DiskPage *dp, int n, Expense *rows, char **text) {
+    const DiskSection *s = v2_find(lz->sec, lz->file_size, SEC_BLOCKS, 1, UINT64_MAX);
+    PackBlockHead bh;
+    const BlockCodec *codec;
+    if (!s || dp->offset < s->offset || dp->offset > s->offset + s->size - sizeof bh) return 0;
+    if (!lazy_read(lz, dp->offset, &bh, sizeof bh)) return 0;
+    uint64_t end = s->offset + s->size, at = dp->offset + sizeof bh;
+    if (bh.rows != (uint32_t)n || bh.raw_len > lz->raw_cap || bh.stored_len > end - at ||
+        !(codec = pack_codec((int)bh.codec))) return 0;
+    if (bh.codec == CODEC_NONE) {
+        if (bh.stored_len != bh.raw_len || !lazy_read(lz, at, lz->raw, bh.raw_len)) return 0;
+    } else if (bh.stored_len > lz->stored_cap || !lazy_read(lz, at, lz->stored, bh.stored_len) ||
+               !codec->decompress(lz->stored, bh.stored_len, lz->raw, bh.raw_len)) {
+        return 0;
+    }
+    const char *src;
+    if (!unpack_rows(lz->raw, bh.raw_len, rows, n, lz->h.version == DB_VERSION_DOUBLES, &src)) return 0;
+    size_t len = 0;
+    for (int i = 0; i < n; ++i) {
+        if (rows[i].desc_len >= DESCRIPTION_LEN) return 0;
+        len += rows[i].desc_len;
+    }
+    if (!(*text = malloc(len + 1))) return 0;
+    memcpy(*text, src, len);
+    return 1;
+}
+
+/* decodes page p into a new, uncached page; NULL if it is damaged */
+static LazyPage *lazy_decode(LazyDB *lz, int p) {
+    const DiskPage *dp = &lz->pages[p];
+    uint64_t first = (uint64_t)p * PACK_BLOCK_ROWS;
+    int n = dp->rows;
+    LazyPage *pg = calloc(1, sizeof *pg);
+    if (!pg) return NULL;
+    pg->index = p;
+    pg->n = n;
+    pg->rows = malloc((size_t)(n ? n : 1) * sizeof(Expense));
+    char *packed = NULL;
+    int ok = pg->rows != NULL;
+    if (ok) ok = lz->h.encoding == ENCODING_COLUMNS ? lazy_columns_page(lz, first, n, pg->rows, &packed)
+                                                    : lazy_block_page(lz, dp, n, pg->rows, &packed);
+    /* spread the text out so each description ends in a NUL */
+    size_t len = 0;
+    for (int i = 0; ok && i < n; ++i) len += pg->rows[i].desc_len + 1;
+    if (ok && !(pg->text = malloc(len ? len : 1))) ok = 0;
+    uint64_t o = 0, from = 0;
+    size_t at = 0;
+    while (o < lz->nodd && (uint64_t)lz->odd[o].row < first) o++;
+    for (int i = 0; ok && i < n; ++i) {
+        Expense *e = &pg->rows[i];
+        int c = e->cat_id;
+        if (e->id <= 0 || c < 0 || c >= lz->h.ncat || !lz->names[c][0]) { ok = 0; break; }
+        memcpy(pg->text + at, packed + from, e->desc_len);
+        pg->text[at + e->desc_len] = '\0';
+        from += e->desc_len;
+        e->desc_ref = (unsigned)at;
+        at += e->desc_len + 1;
+        if (e->date_key >= 10000101 && e->date_key <= 99999999) key_to_date(e->date_key, e->date);
+        else e->date[0] = '\0';
+        while (o < lz->nodd && (uint64_t)lz->odd[o].row < first + (uint64_t)i) o++;
+        if (o < lz->nodd && (uint64_t)lz->odd[o].row == first + (uint64_t)i) {
+            memcpy(e->date, lz->odd[o].date, DATE_LEN);
+            e->date[DATE_LEN-1] = '\0';
+        }
+    }
+    free(packed);
+    if (!ok) { free(pg->rows); free(pg->text); free(pg); return NULL; }
+    pg->bytes = sizeof *pg + (size_t)n * sizeof(Expense) + len;
+    return pg;
+}
+
+static void lazy_page_free(LazyPage *pg) {
+    free(pg->rows);
+    free(pg->text);
+    free(pg);
+}
+
+static void lru_unlink(LazyDB *lz, LazyPage *pg) {
+    if (pg->prev) pg->prev->next = pg->next; else lz->head = pg->next;
+    if (pg->next) pg->next->prev = pg->prev; else lz->tail = pg->prev;
+    pg->prev = pg->next = NULL;
+}
+
+static void lru_push(LazyDB *lz, LazyPage *pg) {
+    pg->next = lz->head;
+    if (lz->head) lz->head->prev = pg; else lz->tail = pg;
+    lz->head = pg;
+}
+
+/* page p through the cache; the result stays valid until the next call */
+static const LazyPage *lazy_page(LazyDB *lz, int p) {
+    LazyPage *pg = lz->resident[p];
+    if (pg) {
+        lz->hits++;
+        lru_unlink(lz, pg);
+        lru_push(lz, pg);
+        return pg;
+    }
+    lz->misses++;
+    if (!(pg = lazy_decode(lz, p))) return NULL;
+    lz->resident[p] = pg;
+    lz->nresident++;
+    lz->used += pg->bytes;
+    lru_push(lz, pg);
+    while (lz->used > lz->budget && lz->tail != pg) {
+        LazyPage *old = lz->tail;
+        lru_unlink(lz, old);
+        lz->resident[old->index] = NULL;
+        lz->nresident--;
+        lz->used -= old->bytes;
+        lz->evictions++;
+        lazy_page_free(old);
+    }
+    return pg;
+}
+
+/* files saved before the page directory existed are walked once instead */
+static int lazy_build_pages(LazyDB *lz) {
+    if (!(lz->pages = calloc((size_t)(lz->npages ? lz->npages : 1), sizeof *lz->pages))) return 0;
+    const DiskSection *s = v2_find(lz->sec, lz->file_size, SEC_BLOCKS, 1, UINT64_MAX);
+    uint64_t at = s ? s->offset : 0, left = (uint64_t)lz->h.rows;
+    for (int p = 0; p < lz->npages; ++p) {
+        DiskPage *dp = &lz->pages[p];
+        dp->rows = left < PACK_BLOCK_ROWS ? (int32_t)left : PACK_BLOCK_ROWS;
+        left -= (uint64_t)dp->rows;
+        if (lz->h.encoding == ENCODING_COLUMNS) continue;
+        PackBlockHead bh;
+        if (!s || at + sizeof bh > s->offset + s->size || !lazy_read(lz, at, &bh, sizeof bh)) return 0;
+        dp->offset = at;
+        at += sizeof bh + bh.stored_len;
+    }
+    for (int p = 0; p < lz->npages; ++p) {
+        LazyPage *pg = lazy_decode(lz, p);
+        if (!pg) return 0;
+        uint64_t offset = lz->pages[p].offset;
+        page_init(&lz->pages[p]);
+        lz->pages[p].offset = offset;
+        for (int i = 0; i < pg->n; ++i) page_add(&lz->pages[p], &pg->rows[i]);
+        lazy_page_free(pg);
+    }
+    lz->rebuilt = 1;
+    return 1;
+}
+
+static int lazy_start(LazyDB *lz, const char *filename) {
+    if (FSEEK64(lz->f, 0, SEEK_END) != 0) return 0;
+    lz->file_size = (uint64_t)FTELL64(lz->f);
+    if (lz->file_size < sizeof lz->h || !lazy_read(lz, 0, &lz->h, sizeof lz->h)) return 0;
+    if (!v2_header_ok(&lz->h, lz->file_size)) return 0;
+    uint32_t nsec = v2_known_sections(&lz->h, lz->sec);
+    if (!lazy_read(lz, lz->h.header_size, lz->sec, nsec * sizeof *lz->sec)) return 0;
+    /* shard files keep their category names in the manifest */
+    if (lz->h.ncat == 0 && lz->h.rows > 0) return 0;
+    if (!(lz->names = lazy_section(lz, SEC_CATEGORIES, CAT_LEN, (uint64_t)lz->h.ncat, NULL))) return 0;
+    for (int i = 0; i < lz->h.ncat; ++i) lz->names[i][CAT_LEN-1] = '\0';
+    uint64_t bytes;
+    if (!(lz->odd = lazy_section(lz, SEC_DATE_TEXT, sizeof(DiskDate), UINT64_MAX, &bytes))) return 0;
+    lz->nodd = bytes / sizeof(DiskDate);
+
+    lz->raw_cap = pack_bound(PACK_BLOCK_ROWS);
+    for (int c = 0; c < CODEC_COUNT; ++c) {
+        size_t b = pack_codec(c)->bound(lz->raw_cap);
+        if (b > lz->stored_cap) lz->stored_cap = b;
+    }
+    lz->raw = malloc(lz->raw_cap);
+    lz->stored = malloc(lz->stored_cap);
+    lz->npages = (int)((lz->h.rows + PACK_BLOCK_ROWS - 1) / PACK_BLOCK_ROWS);
+    lz->resident = calloc((size_t)(lz->npages ? lz->npages : 1), sizeof *lz->resident);
+    if (!lz->raw || !lz->stored || !lz->resident) return 0;
+
+    lz->pages = lazy_section(lz, SEC_PAGES, sizeof(DiskPage), (uint64_t)lz->npages, NULL);
+    if (!lz->pages && !lazy_build_pages(lz)) return 0;
+    uint64_t left = (uint64_t)lz->h.rows;
+    for (int p = 0; p < lz->npages; ++p) {
+        uint64_t want = left < PACK_BLOCK_ROWS ? left : PACK_BLOCK_ROWS;
+        if ((uint64_t)lz->pages[p].rows != want) return 0;
+        left -= want;
     }
-    return start;
+    lz->journal_bytes = journal_pending(filename);
+    return 1;
 }
 
-static void trim_inplace(char *s) {
-    if (!s) return;
-    size_t i = 0;
-    while (isspace((unsigned char)s[i])) i++;
-    if (i) memmove(s, s + i, strlen(s + i) + 1);
-    size_t L = strlen(s);
-    while (L > 0 && isspace((unsigned char)s[L-1])) s[--L] = '\0';
+LazyDB *lazy_open(const char *filename, size_t cache_bytes) {
+    LazyDB *lz = calloc(1, sizeof *lz);
+    if (!lz) return NULL;
+    lz->budget = cache_bytes;
+    lz->f = fopen(filename, "rb");
+    if (!lz->f || !lazy_start(lz, filename)) { lazy_close(lz); return NULL; }
+    return lz;
 }
 
-static void ensure_data_dir(void) {
-    MKDIR("data");
+void lazy_close(LazyDB *lz) {
+    if (!lz) return;
+    while (lz->head) {
+        LazyPage *pg = lz->head;
+        lz->head = pg->next;
+        lazy_page_free(pg);
+    }
+    if (lz->f) fclose(lz->f);
+    free(lz->names);
+    free(lz->odd);
+    free(lz->pages);
+    free(lz->resident);
+    free(lz->raw);
+    free(lz->stored);
+    free(lz);
 }
 
-static int date_to_key(const char *d) {
-    if (!d || strlen(d) < 10) return -1;
-    int day = (d[0]-'0')*10 + (d[1]-'0');
-    int mon = (d[3]-'0')*10 + (d[4]-'0');
-    int year = (d[6]-'0')*1000 + (d[7]-'0')*100 + (d[8]-'0')*10 + (d[9]-'0');
-    if (day <=0 || mon <=0 || year <=0) return -1;
-    return year*10000 + mon*100 + day;
+static void lazy_print_row(const LazyDB *lz, const LazyPage *pg, const Expense *e) {
+    char amt[AMOUNT_BUF];
+    printf("%-3d %-10s  %8s  %-12s  %.40s\n", e->id, e->date, format_amount(e->amount, amt),
+           lz->names[e->cat_id], pg->text + e->desc_ref);
 }
 
+static void lazy_list_header(void) {
+    printf("ID  Date       Amount    Category        Description\n");
+    printf("-------------------------------------------------------------------\n");
+}
 
-static int ensure_capacity(ExpenseDB *db) {
-    if (db->size < db->capacity) return 1;
-    int newcap = db->capacity == 0 ? 8 : db->capacity * 2;
-    Expense *tmp = realloc(db->arr, (size_t)newcap * sizeof(Expense));
-    if (!tmp) return 0;
-    db->arr = tmp;
-    db->capacity = newcap;
-    return 1;
+void lazy_list(LazyDB *lz) {
+    if (lz->h.rows == 0) { puts("No expenses recorded."); return; }
+    lazy_list_header();
+    for (int p = 0; p < lz->npages; ++p) {
+        const LazyPage *pg = lazy_page(lz, p);
+        if (!pg) { puts("Damaged page; listing stopped."); return; }
+        for (int i = 0; i < pg->n; ++i) lazy_print_row(lz, pg, &pg->rows[i]);
+    }
 }
 
-void db_init(ExpenseDB *db) {
-    db->arr = NULL;
-    db->size = 0;
-    db->capacity = 0;
-    db->next_id = 1;
-    db->cat_count = 0;
-    add_category(db, "Food");
-    add_category(db, "Transport");
-    add_category(db, "Shopping");
-    add_category(db, "Gym");
+int lazy_print_by_id(LazyDB *lz, int id) {
+    for (int p = 0; p < lz->npages; ++p) {
+        if (id < lz->pages[p].min_id || id > lz->pages[p].max_id) continue;
+        const LazyPage *pg = lazy_page(lz, p);
+        if (!pg) continue;
+        for (int i = 0; i < pg->n; ++i) {
+            if (pg->rows[i].id != id) continue;
+            lazy_list_header();
+            lazy_print_row(lz, pg, &pg->rows[i]);
+            return 1;
+        }
+    }
+    return 0;
 }
 
-void db_free(ExpenseDB *db) {
-    free(db->arr);
-    db->arr = NULL;
-    db->size = db->capacity = 0;
-    db->next_id = 1;
-    db->cat_count = 0;
+/* -1 = no category given, -2 = not in the file */
+static int lazy_category(const LazyDB *lz, const char *name) {
+    if (!name || !name[0]) return -1;
+    char key[CAT_LEN];
+    cat_key(key, name);
+    for (int i = 0; i < lz->h.ncat; ++i)
+        if (lz->names[i][0] && strcmp(lz->names[i], key) == 0) return i;
+    return -2;
 }
 
+/* 0 when the directory rules out every row of the page */
+static int lazy_page_may_match(const DiskPage *dp, int cat_id, int from_key, int to_key) {
+    if (cat_id >= 0 && !(dp->cat_mask & (1ull << (cat_id & 63)))) return 0;
+    if (from_key == -1 && to_key == -1) return 1;
+    if (dp->min_key > dp->max_key) return 0;
+    return (from_key == -1 || dp->max_key >= from_key) && (to_key == -1 || dp->min_key <= to_key);
+}
 
-int category_exists(const ExpenseDB *db, const char *cat) {
-    if (!cat) return 0;
-    for (int i = 0; i < db->cat_count; ++i)
-        if (strcmp(db->categories[i], cat) == 0) return 1;
-    return 0;
+void lazy_list_filtered(LazyDB *lz, const char *category, const char *from_date,
+                        const char *to_date, const char *substr_in_description) {
+    if (lz->h.rows == 0) { puts("No expenses recorded."); return; }
+    int cat_id = lazy_category(lz, category);
+    int from_key = (from_date && from_date[0]) ? date_to_key(from_date) : -1;
+    int to_key = (to_date && to_date[0]) ? date_to_key(to_date) : -1;
+    const char *text = (substr_in_description && substr_in_description[0]) ? substr_in_description : NULL;
+    int found = 0;
+    long long total = 0;
+    lazy_list_header();
+    for (int p = 0; cat_id != -2 && p < lz->npages; ++p) {
+        if (!lazy_page_may_match(&lz->pages[p], cat_id, from_key, to_key)) continue;
+        const LazyPage *pg = lazy_page(lz, p);
+        if (!pg) { puts("Damaged page skipped."); continue; }
+        for (int i = 0; i < pg->n; ++i) {
+            const Expense *e = &pg->rows[i];
+            if (cat_id >= 0 && e->cat_id != cat_id) continue;
+            if (from_key != -1 || to_key != -1) {
+                if (e->date_key == -1) continue;
+                if (from_key != -1 && e->date_key < from_key) continue;
+                if (to_key != -1 && e->date_key > to_key) continue;
+            }
+            if (text && !strstr(pg->text + e->desc_ref, text)) continue;
+            lazy_print_row(lz, pg, e);
+            found++;
+            total += e->amount;
+        }
+    }
+    if (!found) { puts("No matching expenses."); return; }
+    char amt[AMOUNT_BUF];
+    printf("%d matching, total %s\n", found, format_amount(total, amt));
 }
 
-int add_category(ExpenseDB *db, const char *cat) {
-    if (!cat || cat[0] == '\0') return 0;
-    if (db->cat_count >= MAX_CATS) return 0;
-    if (category_exists(db, cat)) return 1;
-    strncpy(db->categories[db->cat_count], cat, CAT_LEN-1);
-    db->categories[db->cat_count][CAT_LEN-1] = '\0';
-    db->cat_count++;
-    return 1;
+void lazy_monthly_summary(LazyDB *lz, const char *year_month) {
+    int mkey = month_to_key(year_month);
+    long long total = 0;
+    unsigned days = 0;
+    long long *per = calloc((size_t)(lz->h.ncat ? lz->h.ncat : 1), sizeof *per);
+    int *count = calloc((size_t)(lz->h.ncat ? lz->h.ncat : 1), sizeof *count);
+    if (!per || !count) { free(per); free(count); puts("Out of memory."); return; }
+    for (int p = 0; mkey != -1 && p < lz->npages; ++p) {
+        if (!lazy_page_may_match(&lz->pages[p], -1, mkey + 1, mkey + 31)) continue;
+        const LazyPage *pg = lazy_page(lz, p);
+        if (!pg) { puts("Damaged page skipped."); continue; }
+        for (int i = 0; i < pg->n; ++i) {
+            const Expense *e = &pg->rows[i];
+            if (e->date_key <= mkey || e->date_key > mkey + 31) continue;
+            total += e->amount;
+            days |= 1u << (e->date_key % 100);
+            per[e->cat_id] += e->amount;
+            count[e->cat_id]++;
+        }
+    }
+    int count_days = count_bits(days);
+    char amt[AMOUNT_BUF];
+    printf("Summary for %s\n", year_month);
+    printf("Total spent: %s\n", format_amount(total, amt));
+    if (count_days > 0) {
+        printf("Average per active day: %s\n", format_amount(div_round(total, count_days), amt));
+        puts("Category breakdown:");
+        for (int ci = 0; ci < lz->h.ncat; ++ci)
+            if (count[ci] > 0) printf("%-12s : %9s\n", lz->names[ci], format_amount(per[ci], amt));
+    } else {
+        printf("No expenses recorded this month.\n");
+    }
+    free(per);
+    free(count);
 }
 
-int remove_category(ExpenseDB *db, const char *cat) {
-    if (!category_exists(db, cat)) return 0;
-    for (int i = 0; i < db->size; ++i) {
-        if (strcmp(db->arr[i].category, cat) == 0) return 0; /* in use */
+void lazy_print_stats(const LazyDB *lz) {
+    printf("Rows: %lld in %d pages of up to %d (%s)\n", (long long)lz->h.rows, lz->npages, PACK_BLOCK_ROWS,
+           lz->rebuilt ? "page directory rebuilt on open; save the DB once to store it" : "page directory read from file");
+    printf("Cache: %d pages resident, %.1f of %.1f MB\n", lz->nresident,
+           lz->used / 1048576.0, lz->budget / 1048576.0);
+    printf("Hits: %llu, misses: %llu, evictions: %llu\n", lz->hits, lz->misses, lz->evictions);
+    if (lz->journal_bytes > 0)
+        puts("Note: the journal holds changes not in the snapshot; they show once the DB is loaded in full.");
+}
+
+
+#define IMPORT_MAX_THREADS 64
+#define IMPORT_MIN_CHUNK (1 << 20)
+
+/* one newline-aligned slice of the input, parsed by one thread straight
+   into rows reserved for it at the end of db->arr */
+typedef struct {
+    const char *buf;
+    size_t begin, end;
+    Expense *out;
+    int cap;                /* lines in the slice + 1 */
+    int rows;
+    CategoryDict cats;      /* slice-local ids, mapped to the DB's on merge */
+    StringArena descs;      /* slice-local text, handed to the DB on merge */
+    int cut;                /* descriptions shortened to DESCRIPTION_LEN - 1 */
+    int failed;
+} ImportChunk;
+
+static void *import_chunk(void *arg) {
+    ImportChunk *c = arg;
+    size_t pos = c->begin;
+    CsvField fld[5];
+    char cat[CAT_LEN] = "";
+    int cat_id = -1, nf;
+    while (c->rows < c->cap && (nf = csv_next_record(c->buf, c->end, &pos, fld, 5)) >= 0) {
+        if (nf < 4) continue;
+        Expense *e = &c->out[c->rows];
+        memset(e, 0, sizeof *e);
+
+        /* accepts ISO YYYY-MM-DD as well as DD-MM-YYYY */
+        const char *d = fld[1].ptr;
+        if (fld[1].len >= 10 && d[4] == '-') {
+            char iso[DATE_LEN] = { d[8], d[9], '-', d[5], d[6], '-', d[0], d[1], d[2], d[3], '\0' };
+            memcpy(e->date, iso, DATE_LEN);
+        } else {
+            csv_field_copy(e->date, DATE_LEN, &fld[1]);
+        }
+
+        csv_parse_cents(fld[2].ptr, fld[2].len, &e->amount);
+
+        /* exports are usually runs of the same category; skip the lookup then */
+        char name[CAT_LEN];
+        csv_field_copy(name, sizeof name, &fld[3]);
+        if (name[0] == '\0') strcpy(name, "Misc");
+        if (cat_id < 0 || strcmp(name, cat) != 0) {
+            cat_id = cat_dict_intern(&c->cats, name);
+            if (cat_id < 0) { c->failed = 1; break; }
+            strcpy(cat, name);
+        }
+        e->cat_id = cat_id;
+
+        if (nf >= 5) {
+            /* one byte spare tells a description that was too long */
+            char desc[DESCRIPTION_LEN + 1];
+            size_t len = csv_field_copy(desc, sizeof desc, &fld[4]);
+            if (len > DESCRIPTION_LEN - 1) { len = DESCRIPTION_LEN - 1; c->cut++; }
+            e->desc_len = (unsigned)len;
+            if (len && !arena_put(&c->descs, desc, len, &e->desc_ref)) { c->failed = 1; break; }
+        }
+        c->rows++;
     }
-    int idx = -1;
-    for (int i = 0; i < db->cat_count; ++i) if (strcmp(db->categories[i], cat) == 0) { idx = i; break; }
-    if (idx == -1) return 0;
-    for (int i = idx; i + 1 < db->cat_count; ++i) strcpy(db->categories[i], db->categories[i+1]);
-    db->cat_count--;
+    return NULL;
+}
+
+/* threads <= 0 means FINANCE_IMPORT_THREADS, else one per CPU */
+static int import_threads(int requested) {
+    if (requested > 0) return requested;
+    const char *env = getenv("FINANCE_IMPORT_THREADS");
+    if (env && atoi(env) > 0) return atoi(env);
+#ifndef _WIN32
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) return (int)n;
+#endif
     return 1;
 }
 
-int rename_category(ExpenseDB *db, const char *oldname, const char *newname) {
-    if (!category_exists(db, oldname)) return 0;
-    if (!newname || newname[0]=='\0') return 0;
-    if (category_exists(db, newname)) return 0; /* avoid duplicate */
-    int idx = -1;
-    for (int i = 0; i < db->cat_count; ++i) if (strcmp(db->categories[i], oldname) == 0) { idx = i; break; }
-    if (idx == -1) return 0;
-    strncpy(db->categories[idx], newname, CAT_LEN-1);
-    db->categories[idx][CAT_LEN-1] = '\0';
-    /* update expenses */
-    for (int i = 0; i < db->size; ++i) {
-        if (strcmp(db->arr[i].category, oldname) == 0) {
-            strncpy(db->arr[i].category, newname, CAT_LEN-1);
-            db->arr[i].category[CAT_LEN-1] = '\0';
+static void run_import_chunks(ImportChunk *ch, int n) {
+#ifndef _WIN32
+    pthread_t tid[IMPORT_MAX_THREADS];
+    int started[IMPORT_MAX_THREADS] = {0};
+    for (int k = 1; k < n; ++k) started[k] = pthread_create(&tid[k], NULL, import_chunk, &ch[k]) == 0;
+    import_chunk(&ch[0]);
+    for (int k = 1; k < n; ++k) {
+        if (started[k]) pthread_join(tid[k], NULL);
+        else import_chunk(&ch[k]);
+    }
+#else
+    for (int k = 0; k < n; ++k) import_chunk(&ch[k]);
+#endif
+}
+
+/* Slices are parsed in parallel, then merged in file order so ids and
+   category ids come out exactly as a sequential import would give them. */
+static int import_csv(ExpenseDB *db, const char *filename, int threads) {
+    CsvBuffer b;
+    if (!csv_open(&b, filename)) return 0;
+    size_t pos = 0;
+    CsvField fld[5];
+    if (csv_next_record(b.data, b.size, &pos, fld, 5) < 0) { csv_close(&b); return 0; } /* header */
+
+    size_t body = b.size - pos;
+    int parts = import_threads(threads);
+    if (parts > IMPORT_MAX_THREADS) parts = IMPORT_MAX_THREADS;
+    if ((size_t)parts > body / IMPORT_MIN_CHUNK + 1) parts = (int)(body / IMPORT_MIN_CHUNK + 1);
+    size_t bounds[IMPORT_MAX_THREADS + 1];
+    parts = csv_split(b.data + pos, body, parts, bounds);
+
+    ImportChunk ch[IMPORT_MAX_THREADS];
+    size_t total = 0;
+    for (int k = 0; k < parts; ++k) {
+        memset(&ch[k], 0, sizeof ch[k]);
+        ch[k].buf = b.data;
+        ch[k].begin = pos + bounds[k];
+        ch[k].end = pos + bounds[k + 1];
+        size_t lines = csv_count_lines(b.data + ch[k].begin, ch[k].end - ch[k].begin) + 1;
+        total += lines;
+        if (total > (size_t)(INT_MAX / 2) - (size_t)db->size) { csv_close(&b); return 0; }
+        ch[k].cap = (int)lines;
+    }
+    if (!db_reserve(db, db->size + (int)total)) { csv_close(&b); return 0; }
+    int at = db->size;
+    for (int k = 0; k < parts; ++k) { ch[k].out = db->arr + at; at += ch[k].cap; }
+
+    run_import_chunks(ch, parts);
+
+    int ok = 1, first = db->size, cut = 0;
+    db->by_date_sorted = 0; /* sort the date index once at the end */
+    for (int k = 0; k < parts; ++k) {
+        ImportChunk *c = &ch[k];
+        if (c->failed) ok = 0;
+        cut += c->cut;
+        int *remap = malloc((size_t)(c->cats.count ? c->cats.count : 1) * sizeof(int));
+        unsigned base;
+        if (!remap || !arena_adopt(&db->descs, &c->descs, &base)) ok = 0;
+        for (int l = 0; remap && l < c->cats.count; ++l)
+            if ((remap[l] = category_intern(db, c->cats.names[l])) < 0) ok = 0;
+        for (int i = 0; ok && i < c->rows; ++i) {
+            if (!rollup_reserve(&db->months, 2)) { ok = 0; break; }
+            /* slices reserve one row per line, so close the gaps as we go */
+            Expense *e = &db->arr[db->size];
+            if (e != &c->out[i]) *e = c->out[i];
+            e->cat_id = remap[e->cat_id];
+            if (e->desc_len) e->desc_ref += base;
+            e->id = db->next_id++;
+            db_append_row(db, e);
+            rollup_apply(db, e, +1);
         }
+        free(remap);
+        cat_dict_free(&c->cats);
+        arena_free(&c->descs);
     }
-    return 1;
+    csv_close(&b);
+    if (!date_index_rebuild(db)) ok = 0;
+    /* cheaper in one O(rows + days) pass than row by row */
+    if (!day_totals_rebuild(db)) ok = 0;
+    for (int i = first; i < db->size; ++i) journal_log_add(db, &db->arr[i]);
+    journal_commit(db);
+    if (cut) printf("%d description(s) cut to their first %d bytes.\n", cut, DESCRIPTION_LEN - 1);
+    return ok;
 }
 
-void list_categories(const ExpenseDB *db) {
-    if (db->cat_count == 0) { puts("No categories yet."); return; }
-    puts("Categories:");
-    for (int i = 0; i < db->cat_count; ++i) printf(" - %s\n", db->categories[i]);
+int db_import_csv_threads(ExpenseDB *db, const char *filename, int threads) {
+    STAT_START(t0);
+    int before = db->size, ok = import_csv(db, filename, threads);
+    STAT_STOP(SOP_IMPORT_CSV, t0, db->size - before);
+    return ok;
 }
 
+int db_import_csv(ExpenseDB *db, const char *filename) {
+    return db_import_csv_threads(db, filename, 0);
+}
 
-int db_add(ExpenseDB *db, Expense e) {
-    if (!ensure_capacity(db)) return 0;
-    e.id = db->next_id++;
-    e.date[DATE_LEN-1] = '\0';
-    e.category[CAT_LEN-1] = '\0';
-    e.description[DESCRIPTION_LEN-1] = '\0';
-    db->arr[db->size++] = e;
-    add_category(db, e.category);
+
+static void monthly_summary(FILE *out, const ExpenseDB *db, const char *year_month) {
+    int mkey = month_to_key(year_month);
+    const MonthRollup *m = mkey == -1 ? NULL : rollup_find(db, mkey / 100, -1);
+    long long total = m ? m->total : 0;
+    int count_days = m ? count_bits(m->active_days) : 0;
+    char amt[AMOUNT_BUF];
+    fprintf(out, "Summary for %s\n", year_month);
+    fprintf(out, "Total spent: %s\n", format_amount(total, amt));
+    if (count_days > 0) fprintf(out, "Average per active day: %s\n", format_amount(div_round(total, count_days), amt));
+    else { fprintf(out, "No expenses recorded this month.\n"); return; }
+    fputs("Category breakdown:\n", out);
+    for (int ci = 0; ci < db->cats.count; ++ci) {
+        const MonthRollup *c = rollup_find(db, mkey / 100, ci);
+        if (c && c->count > 0) fprintf(out, "%-12s : %9s\n", db->cats.names[ci], format_amount(c->total, amt));
+    }
+}
+
+/* rows counts the rollups looked up; no expense row is touched */
+void db_monthly_summary_to(FILE *out, const ExpenseDB *db, const char *year_month) {
+    STAT_START(t0);
+    monthly_summary(out, db, year_month);
+    STAT_STOP(SOP_MONTHLY_SUMMARY, t0, db->cats.count + 1);
+}
+
+void db_monthly_summary(const ExpenseDB *db, const char *year_month) {
+    db_monthly_summary_to(stdout, db, year_month);
+}
+
+static int cmp_rollup_ym(const void *a, const void *b) {
+    const MonthRollup *x = *(const MonthRollup * const *)a, *y = *(const MonthRollup * const *)b;
+    return (x->ym > y->ym) - (x->ym < y->ym);
+}
+
+static void all_months_summary(const ExpenseDB *db) {
+    const MonthRollup **rows = malloc((size_t)(db->months.count ? db->months.count : 1) * sizeof *rows);
+    if (!rows) return;
+    int n = 0;
+    for (int i = 0; i < db->months.count; ++i) {
+        const MonthRollup *m = &db->months.items[i];
+        if (m->cat_id == -1 && m->count > 0) rows[n++] = m;
+    }
+    if (n == 0) { puts("No expenses recorded."); free(rows); return; }
+    qsort(rows, (size_t)n, sizeof *rows, cmp_rollup_ym);
+    printf("Month     Expenses       Total  Days  Avg/day\n");
+    printf("-----------------------------------------------\n");
+    for (int i = 0; i < n; ++i) {
+        const MonthRollup *m = rows[i];
+        int days = count_bits(m->active_days);
+        char total[AMOUNT_BUF], avg[AMOUNT_BUF];
+        printf("%02d-%04d  %9d  %10s  %4d  %7s\n", m->ym % 100, m->ym / 100, m->count,
+               format_amount(m->total, total), days, format_amount(div_round(m->total, days), avg));
+    }
+    free(rows);
+}
+
+void db_all_months_summary(const ExpenseDB *db) {
+    STAT_START(t0);
+    all_months_summary(db);
+    STAT_STOP(SOP_ALL_MONTHS, t0, db->months.count);
+}
+
+/* undated rows sort first, so the dated ones start at date_lower_bound(1);
+   past that only deleted rows are stepped over, and compaction keeps those
+   to a quarter of the table */
+int db_date_span(const ExpenseDB *db, int *first_key, int *last_key) {
+    int lo = date_lower_bound(db, 1), hi = db->size - 1;
+    while (lo <= hi && db->hot.cat[lo] < 0) lo++;
+    while (hi >= lo && db->hot.cat[hi] < 0) hi--;
+    if (lo > hi) return 0;
+    *first_key = db->hot.key[lo];
+    *last_key = db->hot.key[hi];
     return 1;
 }
 
-int db_find_index_by_id(const ExpenseDB *db, int id) {
-    for (int i = 0; i < db->size; ++i) if (db->arr[i].id == id) return i;
-    return -1;
+/* category id for a query (-1 = all) and day numbers for its dates, with
+   open ends at the first / last dated row; 0 on a bad argument */
+static int range_args(const ExpenseDB *db, const char *category, const char *from_date,
+                      const char *to_date, int *cat_id, int *from, int *to) {
+    *cat_id = -1;
+    if (category && category[0] && (*cat_id = category_find(db, category)) < 0) return 0;
+    if ((from_date && from_date[0] && !is_valid_date(from_date)) || (to_date && to_date[0] && !is_valid_date(to_date)))
+        return 0;
+    int first, last, any = db_date_span(db, &first, &last);
+    *from = from_date && from_date[0] ? key_to_day(date_to_key(from_date)) : any ? key_to_day(first) : 0;
+    *to = to_date && to_date[0] ? key_to_day(date_to_key(to_date)) : any ? key_to_day(last) : -1;
+    return 1;
 }
 
-int db_delete_by_id(ExpenseDB *db, int id) {
-    int idx = db_find_index_by_id(db, id);
-    if (idx < 0) return 0;
-    for (int i = idx; i + 1 < db->size; ++i) db->arr[i] = db->arr[i+1];
-    db->size--;
+int db_range_total(const ExpenseDB *db, const char *category, const char *from_date,
+                   const char *to_date, long long *out) {
+    STAT_START(t0);
+    int cat_id, from, to;
+    if (!range_args(db, category, from_date, to_date, &cat_id, &from, &to)) return 0;
+    *out = day_totals_range(&db->days, cat_id, from, to);
+    STAT_STOP(SOP_RANGE_TOTAL, t0, 0);
     return 1;
 }
 
-void db_list(const ExpenseDB *db) {
-    if (db->size == 0) { puts("No expenses recorded."); return; }
-    printf("ID  Date       Amount    Category        Description\n");
-    printf("-------------------------------------------------------------------\n");
-    for (int i = 0; i < db->size; ++i) {
-        const Expense *e = &db->arr[i];
-        printf("%-3d %-10s  %8.2f  %-12s  %.40s\n", e->id, e->date, e->amount, e->category, e->description);
+int db_rolling_report(const ExpenseDB *db, const char *category, const char *from_date,
+                      const char *to_date, int window, int step) {
+    int cat_id, from, to;
+    if (window < 1 || step < 1 || !range_args(db, category, from_date, to_date, &cat_id, &from, &to)) return 0;
+    STAT_START(t0);
+    char amt[AMOUNT_BUF], avg[AMOUNT_BUF];
+    int points = 0;
+    printf("Spend over the last %d day(s)%s%s\n", window, cat_id < 0 ? "" : ", ", cat_id < 0 ? "" : category_name(db, cat_id));
+    printf("Day         Window total    Avg/day\n");
+    printf("-----------------------------------\n");
+    for (int d = from; d <= to; d += step) {
+        long long s = day_totals_range(&db->days, cat_id, d - window + 1, d);
+        int key = day_to_key(d);
+        printf("%02d-%02d-%04d  %12s  %9s\n", key % 100, key / 100 % 100, key / 10000, format_amount(s, amt),
+               format_amount(div_round(s, window), avg));
+        points++;
     }
+    if (points == 0) puts("No dated expenses in that range.");
+    STAT_STOP(SOP_ROLLING, t0, points);
+    return 1;
 }
 
-void db_list_grouped(const ExpenseDB *db) {
-    if (db->size == 0) { puts("No expenses recorded."); return; }
-    if (db->cat_count > 0) {
-        for (int ci = 0; ci < db->cat_count; ++ci) {
-            const char *cat = db->categories[ci];
-            double total = 0.0;
-            for (int i = 0; i < db->size; ++i) if (strcmp(db->arr[i].category, cat) == 0) total += db->arr[i].amount;
-            if (total <= 0.0) continue;
-            printf("\n%s : %.2f\n", cat, total);
-            for (int i = 0; i < db->size; ++i) {
-                if (strcmp(db->arr[i].category, cat) != 0) continue;
-                const Expense *e = &db->arr[i];
-                printf("   id %-3d  %s  %8.2f  %s\n", e->id, e->date, e->amount, e->description);
+
+static int agg_push(AggGroup **groups, int *n, int *cap, int cat_id, int year, int month, const ColStats *st) {
+    if (st->count == 0) return 1;
+    if (*n == *cap) {
+        AggGroup *tmp = realloc(*groups, (size_t)*cap * 2 * sizeof(AggGroup));
+        if (!tmp) return 0;
+        *groups = tmp;
+        *cap *= 2;
+    }
+    AggGroup *g = &(*groups)[(*n)++];
+    g->cat_id = cat_id;
+    g->year = year;
+    g->month = month;
+    g->count = (int)st->count;
+    g->sum = st->sum;
+    g->min = st->min;
+    g->max = st->max;
+    return 1;
+}
+
+/* count/sum/min/max per group, straight off the hot columns. Date order
+   makes every year or month one contiguous run, so groups come back
+   ordered by (year, month, category id). Returns the number of groups,
+   or -1. */
+static int aggregate(const ExpenseDB *db, int group_by, AggGroup **out) {
+    int cap = 16, n = 0;
+    int nc = (group_by & GROUP_CATEGORY) ? db->cats.count : 0;
+    AggGroup *groups = malloc((size_t)cap * sizeof(AggGroup));
+    ColStats *per = malloc((size_t)(nc ? nc : 1) * sizeof(ColStats));
+    if (!groups || !per) { free(groups); free(per); return -1; }
+    const HotColumns *h = &db->hot;
+    int timed = (group_by & (GROUP_YEAR | GROUP_MONTH)) != 0;
+    for (int p = 0, end; p < db->size; p = end) {
+        /* undated rows first, then one run per year or month */
+        int k = h->key[p], year = 0, month = 0;
+        if (!timed) end = db->size;
+        else if (k <= 0) end = date_lower_bound(db, 1);
+        else {
+            year = k / 10000;
+            if (group_by & GROUP_MONTH) {
+                month = k / 100 % 100;
+                end = date_lower_bound(db, (year * 100 + month + 1) * 100);
+            } else {
+                end = date_lower_bound(db, (year + 1) * 10000);
             }
         }
-    } else {
-        char cats[MAX_CATS][CAT_LEN];
-        int nc=0;
-        for (int i=0;i<db->size;i++) {
-            const char *c = db->arr[i].category;
-            int idx=-1;
-            for (int j=0;j<nc;j++) if (strcmp(cats[j],c)==0) { idx=j; break; }
-            if (idx==-1) { strncpy(cats[nc], c, CAT_LEN-1); cats[nc][CAT_LEN-1]=0; nc++; }
-        }
-        for (int ci=0; ci<nc; ++ci) {
-            const char *cat = cats[ci];
-            double total=0;
-            for (int i=0;i<db->size;i++) if (strcmp(db->arr[i].category, cat)==0) total+=db->arr[i].amount;
-            printf("\n%s : %.2f\n", cat, total);
-            for (int i=0;i<db->size;i++) {
-                if (strcmp(db->arr[i].category, cat)!=0) continue;
-                const Expense *e = &db->arr[i];
-                printf("   id %-3d  %s  %8.2f  %s\n", e->id, e->date, e->amount, e->description);
-            }
+        int ok = 1;
+        if (nc) {
+            for (int c = 0; c < nc; ++c) col_stats_init(&per[c]);
+            col_stats_by_cat(h->amount + p, h->cat + p, (size_t)(end - p), nc, per);
+            for (int c = 0; ok && c < nc; ++c) ok = agg_push(&groups, &n, &cap, c, year, month, &per[c]);
+        } else {
+            ColStats st;
+            col_stats_init(&st);
+            col_stats(h->amount + p, h->key + p, h->cat + p, (size_t)(end - p), -1, INT_MIN, INT_MAX, &st);
+            ok = agg_push(&groups, &n, &cap, -1, year, month, &st);
         }
+        if (!ok) { free(groups); free(per); return -1; }
     }
+    free(per);
+    *out = groups;
+    return n;
 }
 
+int db_aggregate(const ExpenseDB *db, int group_by, AggGroup **out) {
+    STAT_START(t0);
+    int n = aggregate(db, group_by, out);
+    STAT_STOP(SOP_AGGREGATE, t0, n < 0 ? 0 : db->size);
+    return n;
+}
 
-int db_save_binary(const ExpenseDB *db, const char *filename) {
-    ensure_data_dir();
-    FILE *f = fopen(filename, "wb");
-    if (!f) return 0;
-    if (fwrite(&db->size, sizeof(int), 1, f) != 1) { fclose(f); return 0; }
-    if (fwrite(&db->next_id, sizeof(int), 1, f) != 1) { fclose(f); return 0; }
-    if (fwrite(&db->cat_count, sizeof(int), 1, f) != 1) { fclose(f); return 0; }
-    if (db->cat_count > 0) {
-        if (fwrite(db->categories, CAT_LEN, db->cat_count, f) != (size_t)db->cat_count) { fclose(f); return 0; }
+void db_print_aggregate(const ExpenseDB *db, int group_by) {
+    AggGroup *groups;
+    int n = db_aggregate(db, group_by, &groups);
+    if (n < 0) { puts("Out of memory."); return; }
+    if (n == 0) { puts("No expenses recorded."); free(groups); return; }
+    printf("Group                      Count        Total        Min        Max    Average\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (int i = 0; i < n; ++i) {
+        const AggGroup *g = &groups[i];
+        char label[64] = "";
+        size_t len = 0;
+        if (group_by & GROUP_CATEGORY)
+            len += (size_t)snprintf(label + len, sizeof label - len, "%s ", category_name(db, g->cat_id));
+        if (group_by & GROUP_MONTH)
+            len += (size_t)snprintf(label + len, sizeof label - len, "%02d-%04d", g->month, g->year);
+        else if (group_by & GROUP_YEAR)
+            len += (size_t)snprintf(label + len, sizeof label - len, "%04d", g->year);
+        if (len == 0) snprintf(label, sizeof label, "All");
+        char sum[AMOUNT_BUF], lo[AMOUNT_BUF], hi[AMOUNT_BUF], avg[AMOUNT_BUF];
+        printf("%-24.24s %7d %12s %10s %10s %10s\n", label, g->count, format_amount(g->sum, sum),
+               format_amount(g->min, lo), format_amount(g->max, hi), format_amount(div_round(g->sum, g->count), avg));
     }
-    if (db->size > 0) {
-        if (fwrite(db->arr, sizeof(Expense), db->size, f) != (size_t)db->size) { fclose(f); return 0; }
+    free(groups);
+}
+
+
+/* search criteria shared by the filtered list and bulk delete; empty = ignore */
+typedef struct {
+    const ExpenseDB *db;
+    int cat_id;         /* -1 = any, -2 = unknown name (matches nothing) */
+    int from_key, to_key;
+    const char *text;
+    int ignore_case;
+} Filter;
+
+static void filter_init(Filter *f, const ExpenseDB *db, const char *category, const char *from_date,
+                        const char *to_date, const char *substr_in_description) {
+    f->db = db;
+    f->cat_id = -1;
+    if (category && category[0]) {
+        f->cat_id = category_find(db, category);
+        if (f->cat_id < 0) f->cat_id = -2;
     }
-    fclose(f);
-    return 1;
+    f->from_key = (from_date && from_date[0]) ? date_to_key(from_date) : -1;
+    f->to_key = (to_date && to_date[0]) ? date_to_key(to_date) : -1;
+    f->text = (substr_in_description && substr_in_description[0]) ? substr_in_description : NULL;
+    f->ignore_case = (db->search_flags & SEARCH_IGNORE_CASE) != 0;
 }
 
-int db_load_binary(ExpenseDB *db, const char *filename) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) return 0;
+static int contains_nocase(const char *hay, const char *needle) {
+    size_t n = strlen(needle);
+    for (; *hay; ++hay) {
+        size_t i = 0;
+        while (i < n && hay[i] && fold_ascii((unsigned char)hay[i]) == fold_ascii((unsigned char)needle[i])) i++;
+        if (i == n) return 1;
+    }
+    return n == 0;
+}
+
+static int cmp_list_len(const void *a, const void *b) {
+    const TrigramList *x = *(const TrigramList * const *)a, *y = *(const TrigramList * const *)b;
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+/* ascending slots holding every trigram of text, found by intersecting
+   posting lists shortest first. NULL when the index can't answer or
+   would not beat walking limit rows. */
+static int *text_candidates(const ExpenseDB *db, const char *text, int limit, int *count) {
+    size_t len = strlen(text);
+    if (!(db->search_flags & SEARCH_TEXT_INDEX) || len < 3) return NULL;
+    int nl = (int)len - 2;
+    const TrigramList **lists = malloc((size_t)nl * sizeof *lists);
+    if (!lists) return NULL;
+    for (int i = 0; i < nl; ++i) {
+        lists[i] = text_list(&db->text, trigram_at(text + i));
+        if (!lists[i]) { free(lists); *count = 0; return malloc(sizeof(int)); }
+    }
+    qsort(lists, (size_t)nl, sizeof *lists, cmp_list_len);
+    if (lists[0]->len >= limit) { free(lists); return NULL; }
+    int *out = malloc((size_t)(lists[0]->len ? lists[0]->len : 1) * sizeof(int));
+    if (!out) { free(lists); return NULL; }
+    int m = lists[0]->len;
+    memcpy(out, lists[0]->slots, (size_t)m * sizeof(int));
+    for (int k = 1; k < nl && m > 0; ++k) {
+        const int *s = lists[k]->slots;
+        int n = lists[k]->len, lo = 0, w = 0;
+        for (int i = 0; i < m; ++i) {
+            int hi = n;
+            while (lo < hi) { int mid = lo + (hi - lo) / 2; if (s[mid] < out[i]) lo = mid + 1; else hi = mid; }
+            if (lo < n && s[lo] == out[i]) out[w++] = out[i];
+        }
+        m = w;
+    }
+    free(lists);
+    *count = m;
+    return out;
+}
+
+static int cmp_key_slot(const void *a, const void *b) {
+    const KeySlot *x = a, *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+/* date-ranged results come out in date order whichever source is used */
+static void sort_slots_by_date(const ExpenseDB *db, int *slots, int n) {
+    KeySlot *a = malloc((size_t)(n ? n : 1) * sizeof(KeySlot));
+    if (!a) return;
+    for (int i = 0; i < n; ++i) { a[i].key = (unsigned)key_of_slot(db, slots[i]) + 1u; a[i].slot = slots[i]; }
+    qsort(a, (size_t)n, sizeof(KeySlot), cmp_key_slot);
+    for (int i = 0; i < n; ++i) slots[i] = a[i].slot;
+    free(a);
+}
+
+/* candidate slots for a filter, from whichever source is smallest: the
+   trigram candidates, the date index slice, or every row in id order */
+typedef struct {
+    const ExpenseDB *db;
+    int pos, end;
+    int ranged;
+    int *cands;         /* owned; set when walking text candidates */
+} RowScan;
+
+static void scan_begin(RowScan *sc, const ExpenseDB *db, const Filter *f) {
+    sc->db = db;
+    sc->ranged = f->from_key != -1 || f->to_key != -1;
+    sc->pos = 0;
+    sc->end = db->size;
+    sc->cands = NULL;
+    if (sc->ranged) {
+        sc->pos = date_lower_bound(db, f->from_key != -1 ? f->from_key : 0);
+        if (f->to_key != -1) sc->end = date_lower_bound(db, f->to_key + 1);
+    }
     int n;
-    if (fread(&n, sizeof(int), 1, f) != 1) { fclose(f); return 0; }
-    if (fread(&db->next_id, sizeof(int), 1, f) != 1) { fclose(f); return 0; }
-    if (fread(&db->cat_count, sizeof(int), 1, f) != 1) { fclose(f); return 0; }
-    if (db->cat_count > MAX_CATS) { fclose(f); return 0; }
-    if (db->cat_count > 0) {
-        if (fread(db->categories, CAT_LEN, db->cat_count, f) != (size_t)db->cat_count) { fclose(f); return 0; }
+    int *c = f->text ? text_candidates(db, f->text, sc->end - sc->pos, &n) : NULL;
+    if (c && n < sc->end - sc->pos) {
+        if (sc->ranged) sort_slots_by_date(db, c, n);
+        sc->cands = c;
+        sc->pos = 0;
+        sc->end = n;
+        sc->ranged = 0;
+    } else {
+        free(c);
     }
-    db_free(db);
-    if (n > 0) {
-        db->arr = malloc((size_t)n * sizeof(Expense));
-        if (!db->arr) { fclose(f); return 0; }
-        if (fread(db->arr, sizeof(Expense), n, f) != (size_t)n) { free(db->arr); db->arr = NULL; fclose(f); return 0; }
-        db->size = n; db->capacity = n;
+}
+
+static int scan_next(RowScan *sc) {
+    if (sc->pos >= sc->end) return -1;
+    int p = sc->pos++;
+    if (sc->cands) return sc->cands[p];
+    return sc->ranged ? sc->db->by_date[p] : p;
+}
+
+static void scan_end(RowScan *sc) {
+    free(sc->cands);
+    sc->cands = NULL;
+}
+
+static int filter_match(const Filter *f, const Expense *e) {
+    if (ROW_DEAD(e)) return 0;
+    if (f->cat_id != -1 && e->cat_id != f->cat_id) return 0;
+    if (f->from_key != -1 || f->to_key != -1) {
+        int k = e->date_key;
+        if (k == -1) return 0;
+        if (f->from_key != -1 && k < f->from_key) return 0;
+        if (f->to_key != -1 && k > f->to_key) return 0;
+    }
+    if (f->text) {
+        const char *d = expense_description(f->db, e);
+        if (!(f->ignore_case ? contains_nocase(d, f->text) : strstr(d, f->text) != NULL)) return 0;
     }
-    fclose(f);
     return 1;
 }
 
+/* same as db_list_filtered, onto out */
+void db_list_filtered_to(FILE *out, const ExpenseDB *db, const char *category,
+                         const char *from_date, const char *to_date,
+                         const char *substr_in_description) {
+    if (!db || db->live == 0) { fputs("No expenses recorded.\n", out); return; }
 
-int db_export_csv(const ExpenseDB *db, const char *filename) {
-    ensure_data_dir();
-    FILE *f = fopen(filename, "w");
-    if (!f) return 0;
-    fprintf(f, "id,date,amount,category,description\n");
-    for (int i = 0; i < db->size; ++i) {
+    Filter flt;
+    filter_init(&flt, db, category, from_date, to_date, substr_in_description);
+
+    STAT_START(t0);
+    int found = 0, visited = 0;
+    fprintf(out, "ID  Date       Amount    Category        Description\n");
+    fprintf(out, "-------------------------------------------------------------------\n");
+    RowScan sc;
+    scan_begin(&sc, db, &flt);
+    for (int i; (i = scan_next(&sc)) >= 0; ) {
         const Expense *e = &db->arr[i];
-        fprintf(f, "%d,%s,%.2f,%s,%s\n", e->id, e->date, e->amount, e->category, e->description);
+        visited++;
+        if (!filter_match(&flt, e)) continue;
+        char amt[AMOUNT_BUF];
+        fprintf(out, "%-3d %-10s  %8s  %-12s  %.40s\n", e->id, e->date, format_amount(e->amount, amt),
+                category_name(db, e->cat_id), expense_description(db, e));
+        found = 1;
     }
-    fclose(f);
+    scan_end(&sc);
+    STAT_STOP(SOP_FILTER, t0, visited);
+    if (!found) { fputs("No matching expenses.\n", out); return; }
+    AggGroup t;
+    char amt[AMOUNT_BUF];
+    if (db_filter_totals(db, category, from_date, to_date, substr_in_description, &t))
+        fprintf(out, "%d matching, total %s\n", t.count, format_amount(t.sum, amt));
+}
+
+void db_list_filtered(const ExpenseDB *db, const char *category,
+                      const char *from_date, const char *to_date,
+                      const char *substr_in_description) {
+    db_list_filtered_to(stdout, db, category, from_date, to_date, substr_in_description);
+}
+
+/* count/sum/min/max of what db_list_filtered would show. Without a text
+   criterion this is one kernel pass over the date slice of the hot columns. */
+int db_filter_totals(const ExpenseDB *db, const char *category,
+                     const char *from_date, const char *to_date,
+                     const char *substr_in_description, AggGroup *out) {
+    STAT_START(t0);
+    Filter flt;
+    filter_init(&flt, db, category, from_date, to_date, substr_in_description);
+    int visited = 0;
+    ColStats st;
+    col_stats_init(&st);
+    if (flt.cat_id == -2) {
+        /* unknown category: nothing matches */
+    } else if (!flt.text) {
+        int lo = 0, hi = db->size;
+        if (flt.from_key != -1 || flt.to_key != -1) {
+            lo = date_lower_bound(db, flt.from_key != -1 ? flt.from_key : 0);
+            if (flt.to_key != -1) hi = date_lower_bound(db, flt.to_key + 1);
+        }
+        if (hi > lo) {
+            visited = hi - lo;
+            col_stats(db->hot.amount + lo, db->hot.key + lo, db->hot.cat + lo, (size_t)(hi - lo),
+                      flt.cat_id, INT_MIN, INT_MAX, &st);
+        }
+    } else {
+        RowScan sc;
+        scan_begin(&sc, db, &flt);
+        for (int i; (i = scan_next(&sc)) >= 0; ) {
+            const Expense *e = &db->arr[i];
+            visited++;
+            if (!filter_match(&flt, e)) continue;
+            st.count++;
+            st.sum += e->amount;
+            if (e->amount < st.min) st.min = e->amount;
+            if (e->amount > st.max) st.max = e->amount;
+        }
+        scan_end(&sc);
+    }
+    memset(out, 0, sizeof *out);
+    out->cat_id = flt.cat_id >= 0 ? flt.cat_id : -1;
+    out->count = (int)st.count;
+    out->sum = st.sum;
+    out->min = st.count ? st.min : 0;
+    out->max = st.count ? st.max : 0;
+    STAT_STOP(SOP_FILTER_TOTALS, t0, visited);
     return 1;
 }
 
-int db_import_csv(ExpenseDB *db, const char *filename) {
-    FILE *f = fopen(filename, "r");
-    if (!f) return 0;
-    char line[1024];
-    if (!fgets(line, sizeof line, f)) { fclose(f); return 0; } /* skip header */
-    while (fgets(line, sizeof line, f)) {
-        char buf[1024];
-        strncpy(buf, line, sizeof buf-1);
-        buf[sizeof buf-1] = '\0';
-        char *cur = buf;
-        Expense e; memset(&e,0,sizeof e);
-
-        char *tok = next_token(&cur, ','); if (!tok) continue;
-
-        tok = next_token(&cur, ','); if (!tok) continue;
-        trim_inplace(tok);
-        if (strlen(tok) >= 10 && tok[4] == '-') {
-            char day[3] = { tok[8], tok[9], '\0' };
-            char mon[3] = { tok[5], tok[6], '\0' };
-            char year[5] = { tok[0], tok[1], tok[2], tok[3], '\0' };
-            snprintf(e.date, DATE_LEN, "%s-%s-%s", day, mon, year);
-        } else {
-            strncpy(e.date, tok, DATE_LEN-1);
-            e.date[DATE_LEN-1] = '\0';
+/* calls fn for every row db_list_filtered would show; without a text
+   criterion only the date slice of the hot columns is read. Returns the
+   rows visited. */
+typedef void (*MatchFn)(void *ctx, const ExpenseDB *db, int slot, long long amount);
+
+static int filter_each(const ExpenseDB *db, const Filter *f, MatchFn fn, void *ctx) {
+    int visited = 0;
+    if (f->cat_id == -2) return 0;
+    if (!f->text) {
+        int lo = 0, hi = db->size;
+        if (f->from_key != -1 || f->to_key != -1) {
+            lo = date_lower_bound(db, f->from_key != -1 ? f->from_key : 0);
+            if (f->to_key != -1) hi = date_lower_bound(db, f->to_key + 1);
+        }
+        for (int p = lo; p < hi; ++p) {
+            int c = db->hot.cat[p];
+            if (c < 0 || (f->cat_id >= 0 && c != f->cat_id)) continue;
+            fn(ctx, db, db->by_date[p], db->hot.amount[p]);
         }
+        return hi > lo ? hi - lo : 0;
+    }
+    RowScan sc;
+    scan_begin(&sc, db, f);
+    for (int i; (i = scan_next(&sc)) >= 0; ) {
+        visited++;
+        if (filter_match(f, &db->arr[i])) fn(ctx, db, i, db->arr[i].amount);
+    }
+    scan_end(&sc);
+    return visited;
+}
 
-        tok = next_token(&cur, ','); if (!tok) continue;
-        trim_inplace(tok);
-        e.amount = atof(tok);
+/* ---- top k (bounded min-heaps) ---- */
 
-        tok = next_token(&cur, ','); if (!tok) continue;
-        trim_inplace(tok);
-        strncpy(e.category, tok, CAT_LEN-1);
+typedef struct {
+    long long amount;
+    int id;
+    int slot;
+} TopItem;
 
-        tok = cur;
-        trim_inplace(tok);
-        strncpy(e.description, tok, DESCRIPTION_LEN-1);
+/* a ranks below b: smaller amount, or the same amount and a later id */
+static int top_below(const TopItem *a, const TopItem *b) {
+    return a->amount < b->amount || (a->amount == b->amount && a->id > b->id);
+}
 
-        if (e.category[0] == '\0') strncpy(e.category, "Misc", CAT_LEN-1);
-        add_category(db, e.category);
-        db_add(db, e);
+static void top_sift_down(TopItem *h, int n, int i) {
+    for (;;) {
+        int l = 2 * i + 1, m = i;
+        if (l < n && top_below(&h[l], &h[m])) m = l;
+        if (l + 1 < n && top_below(&h[l + 1], &h[m])) m = l + 1;
+        if (m == i) return;
+        TopItem t = h[i]; h[i] = h[m]; h[m] = t;
+        i = m;
     }
-    fclose(f);
-    return 1;
 }
 
+/* keeps the k best rows seen; h[0] is the one to drop next */
+static void top_push(TopItem *h, int *n, int k, long long amount, int id, int slot) {
+    TopItem it = { amount, id, slot };
+    if (*n == k) {
+        if (!top_below(&h[0], &it)) return;
+        h[0] = it;
+        top_sift_down(h, k, 0);
+        return;
+    }
+    int i = (*n)++;
+    while (i > 0 && top_below(&it, &h[(i - 1) / 2])) {
+        h[i] = h[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h[i] = it;
+}
 
-void db_monthly_summary(const ExpenseDB *db, const char *year_month) {
-    double total = 0.0;
-    int days_with_expense[32] = {0};
-    for (int i = 0; i < db->size; ++i) {
-        if (strncmp(db->arr[i].date + 3, year_month, 7) == 0) {
-            total += db->arr[i].amount;
-            int day = 0;
-            if (sscanf(db->arr[i].date, "%2d", &day) == 1 && day >=1 && day <=31) days_with_expense[day] = 1;
+/* heap -> best first, in place */
+static void top_sort(TopItem *h, int n) {
+    for (int m = n - 1; m > 0; --m) {
+        TopItem t = h[0]; h[0] = h[m]; h[m] = t;
+        top_sift_down(h, m, 0);
+    }
+}
+
+/* one heap per group, allocated when the group first has a row */
+typedef struct {
+    int k, group_by, ngroups;
+    TopItem **heaps;
+    int *len;
+    int failed;
+} TopGroups;
+
+static int top_group_of(const ExpenseDB *db, int group_by, int slot) {
+    const Expense *e = &db->arr[slot];
+    if (group_by == GROUP_CATEGORY) return e->cat_id;
+    if (group_by != GROUP_MONTH) return 0;
+    const MonthRollup *m = e->date_key > 0 ? rollup_find(db, e->date_key / 100, -1) : NULL;
+    return m ? (int)(m - db->months.items) : db->months.count;  /* last group: undated */
+}
+
+static void top_visit(void *ctx, const ExpenseDB *db, int slot, long long amount) {
+    TopGroups *tg = ctx;
+    int g = top_group_of(db, tg->group_by, slot);
+    TopItem *h = tg->heaps[g];
+    if (tg->len[g] == tg->k && amount < h[0].amount) return;    /* the common case */
+    if (!h && !(h = tg->heaps[g] = calloc((size_t)tg->k, sizeof(TopItem)))) { tg->failed = 1; return; }
+    top_push(h, &tg->len[g], tg->k, amount, db->arr[slot].id, slot);
+}
+
+static int top_groups_run(const ExpenseDB *db, const Filter *f, int k, int group_by, TopGroups *tg) {
+    tg->k = k;
+    tg->group_by = group_by;
+    tg->ngroups = group_by == GROUP_CATEGORY ? db->cats.count : group_by == GROUP_MONTH ? db->months.count + 1 : 1;
+    tg->heaps = calloc((size_t)(tg->ngroups ? tg->ngroups : 1), sizeof *tg->heaps);
+    tg->len = calloc((size_t)(tg->ngroups ? tg->ngroups : 1), sizeof *tg->len);
+    tg->failed = !tg->heaps || !tg->len;
+    int visited = tg->failed ? 0 : filter_each(db, f, top_visit, tg);
+    for (int g = 0; !tg->failed && g < tg->ngroups; ++g)
+        if (tg->heaps[g]) top_sort(tg->heaps[g], tg->len[g]);
+    return visited;
+}
+
+static void top_groups_free(TopGroups *tg) {
+    for (int g = 0; tg->heaps && g < tg->ngroups; ++g) free(tg->heaps[g]);
+    free(tg->heaps);
+    free(tg->len);
+}
+
+int db_top_k(const ExpenseDB *db, const char *category, const char *from_date, const char *to_date,
+             const char *substr_in_description, int k, int *slots) {
+    if (k <= 0) return 0;
+    STAT_START(t0);
+    Filter flt;
+    filter_init(&flt, db, category, from_date, to_date, substr_in_description);
+    TopGroups tg;
+    int visited = top_groups_run(db, &flt, k, 0, &tg);
+    int n = tg.failed ? -1 : tg.len[0];
+    for (int i = 0; i < n; ++i) slots[i] = tg.heaps[0][i].slot;
+    top_groups_free(&tg);
+    STAT_STOP(SOP_TOP_K, t0, visited);
+    return n;
+}
+
+void db_print_top_k(const ExpenseDB *db, const char *category, const char *from_date, const char *to_date,
+                    const char *substr_in_description, int k, int group_by) {
+    if (k <= 0) return;
+    STAT_START(t0);
+    Filter flt;
+    filter_init(&flt, db, category, from_date, to_date, substr_in_description);
+    if (group_by != GROUP_CATEGORY && group_by != GROUP_MONTH) group_by = 0;
+    TopGroups tg;
+    int visited = top_groups_run(db, &flt, k, group_by, &tg);
+    /* groups in id order, or by month with the undated ones last */
+    KeySlot *order = malloc((size_t)(tg.ngroups ? tg.ngroups : 1) * sizeof(KeySlot));
+    if (tg.failed || !order) {
+        puts("Out of memory.");
+    } else {
+        int n = 0;
+        for (int g = 0; g < tg.ngroups; ++g) {
+            if (!tg.len[g]) continue;
+            order[n].key = group_by != GROUP_MONTH ? 0 : g < db->months.count ? (unsigned)db->months.items[g].ym : UINT_MAX;
+            order[n++].slot = g;
+        }
+        qsort(order, (size_t)n, sizeof *order, cmp_key_slot);
+        if (n == 0) puts("No matching expenses.");
+        for (int i = 0; i < n; ++i) {
+            int g = order[i].slot;
+            if (group_by == GROUP_CATEGORY) printf("\n%s\n", category_name(db, g));
+            else if (group_by == GROUP_MONTH && g < db->months.count)
+                printf("\n%02d-%04d\n", db->months.items[g].ym % 100, db->months.items[g].ym / 100);
+            else if (group_by == GROUP_MONTH) puts("\nNo date");
+            printf("ID  Date       Amount    Category        Description\n");
+            printf("-------------------------------------------------------------------\n");
+            for (int j = 0; j < tg.len[g]; ++j) {
+                const Expense *e = &db->arr[tg.heaps[g][j].slot];
+                char amt[AMOUNT_BUF];
+                printf("%-3d %-10s  %8s  %-12s  %.40s\n", e->id, e->date, format_amount(e->amount, amt),
+                       category_name(db, e->cat_id), expense_description(db, e));
+            }
         }
     }
-    int count_days = 0;
-    for (int d=1; d<=31; ++d) if (days_with_expense[d]) count_days++;
-    printf("Summary for %s\n", year_month);
-    printf("Total spent: %.2f\n", total);
-    if (count_days > 0) printf("Average per active day: %.2f\n", total / count_days);
-    else printf("No expenses recorded this month.\n");
+    free(order);
+    top_groups_free(&tg);
+    STAT_STOP(SOP_TOP_K, t0, visited);
 }
 
+/* ---- percentiles (quickselect) ---- */
 
-void db_list_filtered(const ExpenseDB *db, const char *category,
-                      const char *from_date, const char *to_date,
-                      const char *substr_in_description) {
-    if (!db || db->size == 0) { puts("No expenses recorded."); return; }
+typedef struct {
+    long long *v;
+    int n, cap;
+    int failed;
+} AmountList;
+
+static void amount_visit(void *ctx, const ExpenseDB *db, int slot, long long amount) {
+    AmountList *a = ctx;
+    (void)db;
+    (void)slot;
+    if (a->n == a->cap) {
+        int cap = a->cap ? a->cap * 2 : 1024;
+        long long *v = realloc(a->v, (size_t)cap * sizeof *v);
+        if (!v) { a->failed = 1; return; }
+        a->v = v;
+        a->cap = cap;
+    }
+    a->v[a->n++] = amount;
+}
 
-    int from_key = -1, to_key = -1;
-    if (from_date && from_date[0]) from_key = date_to_key(from_date);
-    if (to_date && to_date[0]) to_key = date_to_key(to_date);
+/* puts the k-th smallest of a[0..n) at a[k], smaller ones before it and
+   larger ones after (Hoare partitions around a median of three) */
+static long long select_kth(long long *a, int n, int k) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        long long x = a[lo], y = a[lo + (hi - lo) / 2], z = a[hi];
+        long long pivot = x < y ? (y < z ? y : x < z ? z : x) : (x < z ? x : y < z ? z : y);
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i <= j) { long long t = a[i]; a[i] = a[j]; a[j] = t; i++; j--; }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return a[k];
+}
 
-    int found = 0;
-    printf("ID  Date       Amount    Category        Description\n");
-    printf("-------------------------------------------------------------------\n");
+int db_percentiles(const ExpenseDB *db, const char *category, const char *from_date, const char *to_date,
+                   const char *substr_in_description, const double *pct, int n, long long *out) {
+    STAT_START(t0);
+    Filter flt;
+    filter_init(&flt, db, category, from_date, to_date, substr_in_description);
+    AmountList a = { NULL, 0, 0, 0 };
+    int visited = filter_each(db, &flt, amount_visit, &a);
+    int *order = malloc((size_t)(n > 0 ? n : 1) * sizeof(int));
+    if (a.failed || !order) { free(a.v); free(order); return -1; }
+    /* ascending ranks, so each select only looks right of the last one */
+    for (int i = 0; i < n; ++i) {
+        int j = i;
+        for (; j > 0 && pct[order[j - 1]] > pct[i]; --j) order[j] = order[j - 1];
+        order[j] = i;
+    }
+    int done = 0;
+    for (int i = 0; a.n > 0 && i < n; ++i) {
+        double p = pct[order[i]] < 0 ? 0 : pct[order[i]] > 100 ? 100 : pct[order[i]];
+        int rank = (int)(p / 100.0 * a.n + 0.999999999);    /* nearest rank, 1-based */
+        int at = rank > 0 ? rank - 1 : 0;
+        if (at < done) at = done;
+        out[order[i]] = select_kth(a.v + done, a.n - done, at - done);
+        done = at;
+    }
+    free(order);
+    free(a.v);
+    STAT_STOP(SOP_PERCENTILE, t0, visited);
+    return a.n;
+}
+
+void db_print_percentiles(const ExpenseDB *db, const char *category, const char *from_date,
+                          const char *to_date, const char *substr_in_description) {
+    static const double pct[] = { 0, 25, 50, 75, 90, 95, 99, 100 };
+    static const char *names[] = { "Min", "P25", "Median", "P75", "P90", "P95", "P99", "Max" };
+    long long v[sizeof pct / sizeof pct[0]];
+    int n = db_percentiles(db, category, from_date, to_date, substr_in_description, pct, (int)(sizeof pct / sizeof pct[0]), v);
+    if (n < 0) { puts("Out of memory."); return; }
+    if (n == 0) { puts("No matching expenses."); return; }
+    printf("%d matching\n", n);
+    for (size_t i = 0; i < sizeof pct / sizeof pct[0]; ++i) {
+        char amt[AMOUNT_BUF];
+        printf("%-7s %12s\n", names[i], format_amount(v[i], amt));
+    }
+}
+
+/* removes every row matching the criteria in one stable pass; returns how
+   many. -1 if memory ran out: either before the pass, with nothing removed,
+   or rebuilding the id index after it, when the rows are gone and the
+   delete is journalled all the same */
+static int delete_where(ExpenseDB *db, const char *category,
+                        const char *from_date, const char *to_date,
+                        const char *substr_in_description) {
+    Filter flt;
+    filter_init(&flt, db, category, from_date, to_date, substr_in_description);
+    /* the date index is re-sorted after rows are gone; get its room first */
+    KeySlot *scratch = date_index_scratch(db->size);
+    if (!scratch) return -1;
+
+    int w = 0, removed = 0;
     for (int i = 0; i < db->size; ++i) {
         const Expense *e = &db->arr[i];
-        if (category && category[0]) {
-            if (strcmp(e->category, category) != 0) continue;
-        }
-        if (from_key != -1 || to_key != -1) {
-            int k = date_to_key(e->date);
-            if (k == -1) continue;
-            if (from_key != -1 && k < from_key) continue;
-            if (to_key != -1 && k > to_key) continue;
+        if (ROW_DEAD(e)) continue;
+        if (filter_match(&flt, e)) {
+            db->cats.rows[e->cat_id]--;
+            rollup_apply(db, e, -1);
+            day_totals_apply(db, e, -1);
+            shard_touch(db, e);
+            desc_release(db, e);
+            removed++;
+            continue;
         }
-        if (substr_in_description && substr_in_description[0]) {
-            if (!strstr(e->description, substr_in_description)) continue;
-        }
-        printf("%-3d %-10s  %8.2f  %-12s  %.40s\n", e->id, e->date, e->amount, e->category, e->description);
-        found = 1;
+        if (w != i) db->arr[w] = db->arr[i];
+        w++;
+    }
+    if (w == db->size) { free(scratch); return 0; }
+    db->size = w;
+    db->live = w;
+    desc_compact(db);
+    int ok = id_index_rebuild(db, db->live);
+    date_index_sort(db, scratch);
+    free(scratch);
+    /* short of memory this drops the text index and searches scan instead */
+    text_index_rebuild(db);
+    journal_log_delete_where(db, category, from_date, to_date, substr_in_description);
+    journal_commit(db);
+    return ok ? removed : -1;
+}
+
+int db_delete_where(ExpenseDB *db, const char *category,
+                    const char *from_date, const char *to_date,
+                    const char *substr_in_description) {
+    STAT_START(t0);
+    int scanned = db->size, removed = delete_where(db, category, from_date, to_date, substr_in_description);
+    STAT_STOP(SOP_DELETE_WHERE, t0, scanned);
+    return removed;
+}
+
+/* streams matching rows through a large buffer; nothing is materialized */
+int db_export_csv_filtered(const ExpenseDB *db, const char *filename, const char *category,
+                           const char *from_date, const char *to_date,
+                           const char *substr_in_description) {
+    Filter flt;
+    filter_init(&flt, db, category, from_date, to_date, substr_in_description);
+    ensure_data_dir();
+    CsvWriter w;
+    if (!csv_writer_open(&w, filename)) return 0;
+    static const char header[] = "id,date,amount,category,description\n";
+    csv_put_raw(&w, header, sizeof header - 1);
+    STAT_START(t0);
+    int written = 0;
+    RowScan sc;
+    scan_begin(&sc, db, &flt);
+    for (int i; (i = scan_next(&sc)) >= 0; ) {
+        const Expense *e = &db->arr[i];
+        if (!filter_match(&flt, e)) continue;
+        written++;
+        csv_put_int(&w, e->id);
+        csv_put_char(&w, ',');
+        csv_put_raw(&w, e->date, strlen(e->date));
+        csv_put_char(&w, ',');
+        csv_put_cents(&w, e->amount);
+        csv_put_char(&w, ',');
+        csv_put_field(&w, category_name(db, e->cat_id));
+        csv_put_char(&w, ',');
+        csv_put_field(&w, expense_description(db, e));
+        csv_put_char(&w, '\n');
     }
-    if (!found) puts("No matching expenses.");
+    scan_end(&sc);
+    int ok = csv_writer_close(&w);
+    STAT_STOP(SOP_EXPORT_CSV, t0, written);
+    return ok;
+}
+
+int db_export_csv(const ExpenseDB *db, const char *filename) {
+    return db_export_csv_filtered(db, filename, NULL, NULL, NULL, NULL);
 }
 
 
@@ -385,12 +3461,33 @@ int is_valid_date(const char *d) {
     return 1;
 }
 
-int parse_amount(const char *s, double *out) {
+/* "12.5" -> 1250; a third decimal rounds, negatives are rejected */
+int parse_amount(const char *s, long long *out) {
     if (!s || !*s) return 0;
-    char *end;
-    double v = strtod(s, &end);
-    if (end == s) return 0;
-    if (v < 0.0) return 0;
+    long long v;
+    if (!csv_parse_cents(s, strlen(s), &v) || v < 0) return 0;
     if (out) *out = v;
     return 1;
 }
+
+/* formats cents as "-1234.56" into buf (AMOUNT_BUF bytes) and returns it */
+char *format_amount(long long cents, char *buf) {
+    char tmp[AMOUNT_BUF];
+    unsigned long long v = cents < 0 ? 0ull - (unsigned long long)cents : (unsigned long long)cents;
+    int n = 0;
+    tmp[n++] = (char)('0' + v % 10); v /= 10;
+    tmp[n++] = (char)('0' + v % 10); v /= 10;
+    tmp[n++] = '.';
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+    if (cents < 0) tmp[n++] = '-';
+    for (int i = 0; i < n; ++i) buf[i] = tmp[n - 1 - i];
+    buf[n] = '\0';
+    return buf;
+}
+
+/* nearest cent; older files and journals stored doubles */
+long long amount_from_double(double v) {
+    double c = v * 100.0;
+    if (!(c > -9e18 && c < 9e18)) return 0;
+    return (long long)(c < 0 ? c - 0.5 : c + 0.5);
+}
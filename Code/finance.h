@@ -1,59 +1,288 @@
 #ifndef FINANCE_H
 #define FINANCE_H
 
-#define DESCRIPTION_LEN 128
+#include <stddef.h>
+#include <stdio.h>
+
+#define DESCRIPTION_LEN 1024    /* longest description kept, with its terminator;
+                                   adds and imports report longer ones */
 #define DATE_LEN 11    
 #define CAT_LEN 32
-#define MAX_CATS 64
 
 typedef struct {
     int id;
     char date[DATE_LEN];    
-    double amount;
-    char category[CAT_LEN];
-    char description[DESCRIPTION_LEN];
+    int date_key;       /* YYYYMMDD parsed from date, -1 if unparseable */
+    long long amount;   /* minor units (cents) */
+    int cat_id;         /* index into ExpenseDB.cats */
+    unsigned desc_ref;  /* text in ExpenseDB.descs, see expense_description */
+    unsigned desc_len;
 } Expense;
 
+/* description text, NUL-terminated, packed into chunks that never move.
+   A row names its text as chunk << ARENA_CHUNK_BITS | offset. */
+#define ARENA_CHUNK_BITS 20
+#define ARENA_MAX_CHUNKS 4096   /* 4 GB of text with 32-bit refs */
+
+typedef struct {
+    char **chunks;
+    int count, cap;
+    unsigned used;          /* bytes taken in the last chunk */
+    size_t live, dead;      /* bytes held by live rows / by deleted ones */
+} StringArena;
+
+/* interned category names; ids are stable for the life of the DB */
+typedef struct {
+    char (*names)[CAT_LEN];   /* by id, "" once removed */
+    int *rows;                /* live expenses per id */
+    int count;                /* ids handed out */
+    int capacity;
+    int *hash;                /* name -> id, -1 = empty */
+    int hash_cap;
+    int active;               /* ids not removed */
+} CategoryDict;
+
+/* running totals for one month, overall (cat_id -1) or for one category */
+typedef struct {
+    int ym;                 /* YYYYMM */
+    int cat_id;
+    long long total;        /* cents */
+    int count;
+    unsigned active_days;   /* bit d set while day d has rows */
+    int day_rows[32];
+} MonthRollup;
+
+typedef struct {
+    MonthRollup *items;
+    int count;
+    int capacity;
+    int *hash;              /* (ym, cat_id) -> item, -1 = empty */
+    int hash_cap;
+} RollupTable;
+
+/* per-day totals in blocks of DAY_BLOCK days, each a Fenwick tree that
+   exists only once a row falls in it, so a lone far-off date costs one
+   block rather than every day in between. A second Fenwick tree over the
+   block totals covers whole blocks, so a range total is a few prefix sums
+   whatever the gap between its ends. */
+#define DAY_BLOCK 512
+
+typedef struct {
+    int block;              /* days block * DAY_BLOCK .. + DAY_BLOCK - 1 */
+    long long total;        /* cents */
+    long long *tree;        /* DAY_BLOCK + 1 entries, [0] unused */
+} DayBlock;
+
+typedef struct {
+    DayBlock *blocks;       /* sorted by block */
+    long long *outer;       /* tree over blocks[].total, capacity + 1 entries */
+    int count;
+    int capacity;
+} DaySeries;
+
+/* one series over all rows and one per category id; ids survive renames */
+typedef struct {
+    DaySeries all;
+    DaySeries *by_cat;      /* by category id, empty until the id has a row */
+    int ncat;
+} DayTotals;
+
+/* posting list of one lowercased description trigram */
+typedef struct {
+    unsigned key;           /* 3 bytes packed, 0 = empty bucket */
+    int len, cap;
+    int *slots;             /* ascending */
+} TrigramList;
+
+typedef struct {
+    TrigramList *lists;
+    int count;
+    int cap;
+} TextIndex;
+
+/* the fields scans aggregate over, copied out of the rows in by_date order
+   so the kernels stream through them; cat is -1 where the row is deleted */
+typedef struct {
+    long long *amount;
+    int *key;
+    int *cat;
+} HotColumns;
+
+typedef struct Journal Journal;
+
+/* set of YYYYMM months, 0 standing for rows without a usable date */
+typedef struct {
+    int *keys;          /* -1 = empty */
+    int cap;
+    int count;
+} MonthSet;
+
+/* what the in-memory rows mean relative to a month-sharded directory */
+typedef struct {
+    char dir[128];      /* shard directory the sets refer to, "" = none */
+    MonthSet dirty;     /* months changed since the last shard load/save */
+    MonthSet loaded;    /* months held completely in memory */
+    int all_dirty;      /* dirty set could not grow: rewrite every month */
+    int partial;        /* some shards on disk are not loaded */
+} ShardState;
+
+/* db_set_search_flags */
+#define SEARCH_IGNORE_CASE 1
+#define SEARCH_TEXT_INDEX  2
+
+/* db_set_encoding: how rows are laid out in saved files */
+#define ENCODING_COLUMNS   0    /* fixed-width columns, fastest to load */
+#define ENCODING_PACKED    1    /* varint/delta row blocks */
+#define ENCODING_PACKED_LZ 2    /* packed blocks, LZ compressed */
+
+/* group_by flags for db_aggregate; MONTH means month of a given year */
+#define GROUP_CATEGORY 1
+#define GROUP_MONTH    2
+#define GROUP_YEAR     4
+
+typedef struct {
+    int cat_id;         /* -1 unless grouped by category */
+    int year;           /* 0 unless grouped by year or month */
+    int month;          /* 0 unless grouped by month */
+    int count;
+    long long sum, min, max;    /* cents */
+} AggGroup;
+
 typedef struct {
     Expense *arr;
     int size;
     int capacity;
     int next_id;
+    int live;           /* rows not marked deleted (id == 0) */
+
+    int *id_slots;      /* id -> slot hash index, -1 = empty */
+    int id_slots_cap;
+
+    int *by_date;       /* every slot, ordered by (date_key, id) */
+    int by_date_sorted; /* 0 while a bulk import appends unsorted */
+    HotColumns hot;     /* parallel to by_date */
 
-   
-    char categories[MAX_CATS][CAT_LEN];
-    int cat_count;
+    CategoryDict cats;
+    RollupTable months;
+    DayTotals days;
+    StringArena descs;
+
+    int search_flags;
+    TextIndex text;     /* built while SEARCH_TEXT_INDEX is set */
+
+    Journal *journal;   /* NULL = changes are not logged */
+    unsigned long long journal_seq; /* last journal record applied or written */
+
+    ShardState shards;
+    int encoding;       /* ENCODING_* used by the next save */
+    unsigned long long changes; /* bumped by every change, logged or not */
 } ExpenseDB;
 
 void db_init(ExpenseDB *db);
 void db_free(ExpenseDB *db);
 
 int category_exists(const ExpenseDB *db, const char *cat);
+int category_find(const ExpenseDB *db, const char *cat);
+int category_intern(ExpenseDB *db, const char *cat);
+const char *category_name(const ExpenseDB *db, int cat_id);
 int add_category(ExpenseDB *db, const char *cat);
 int remove_category(ExpenseDB *db, const char *cat); 
 int rename_category(ExpenseDB *db, const char *oldname, const char *newname);
 void list_categories(const ExpenseDB *db);
 
-int db_add(ExpenseDB *db, Expense e);
+int db_add(ExpenseDB *db, Expense e, const char *description);
+const char *expense_description(const ExpenseDB *db, const Expense *e);
 int db_delete_by_id(ExpenseDB *db, int id);
 int db_find_index_by_id(const ExpenseDB *db, int id);
+int db_compact(ExpenseDB *db);
 void db_list(const ExpenseDB *db); 
 void db_list_grouped(const ExpenseDB *db); 
+void db_list_grouped_to(FILE *out, const ExpenseDB *db);
 
 void db_list_filtered(const ExpenseDB *db, const char *category,
                       const char *from_date, const char *to_date,
                       const char *substr_in_description);
+void db_list_filtered_to(FILE *out, const ExpenseDB *db, const char *category,
+                         const char *from_date, const char *to_date,
+                         const char *substr_in_description);
+int db_filter_totals(const ExpenseDB *db, const char *category,
+                     const char *from_date, const char *to_date,
+                     const char *substr_in_description, AggGroup *out);
+/* slots (into db->arr) of the k largest amounts among the rows
+   db_list_filtered would show, largest first, ties by lower id; a bounded
+   heap, O(rows log k). Returns how many, -1 on no memory */
+int db_top_k(const ExpenseDB *db, const char *category, const char *from_date, const char *to_date,
+             const char *substr_in_description, int k, int *slots);
+/* the same per category (GROUP_CATEGORY), per month (GROUP_MONTH) or overall (0) */
+void db_print_top_k(const ExpenseDB *db, const char *category, const char *from_date, const char *to_date,
+                    const char *substr_in_description, int k, int group_by);
+/* nearest-rank percentiles (0..100) of those rows' amounts, by quickselect
+   over a copy of the amounts alone. Returns the number of matching rows
+   (out is left alone when 0), -1 on no memory */
+int db_percentiles(const ExpenseDB *db, const char *category, const char *from_date, const char *to_date,
+                   const char *substr_in_description, const double *pct, int n, long long *out);
+void db_print_percentiles(const ExpenseDB *db, const char *category, const char *from_date,
+                          const char *to_date, const char *substr_in_description);
+int db_set_search_flags(ExpenseDB *db, int flags);
+int db_set_encoding(ExpenseDB *db, int encoding);
+/* how many rows went, -1 on no memory; a delete that got as far as
+   removing rows is journalled either way */
+int db_delete_where(ExpenseDB *db, const char *category,
+                    const char *from_date, const char *to_date,
+                    const char *substr_in_description);
 
 
-int db_save_binary(const ExpenseDB *db, const char *filename);
+int db_save_binary(ExpenseDB *db, const char *filename);
+/* copy of the live rows for a background save, O(live rows); descriptions
+   are shared, not copied */
+int db_snapshot(const ExpenseDB *db, ExpenseDB *snap);
+int db_save_snapshot(const ExpenseDB *snap, const char *filename);
+int db_journal_attach(ExpenseDB *db, const char *snapshot);
 int db_load_binary(ExpenseDB *db, const char *filename);
+int db_save_sharded(ExpenseDB *db, const char *dir);
+int db_load_sharded(ExpenseDB *db, const char *dir, const char *from_month, const char *to_month);
 int db_export_csv(const ExpenseDB *db, const char *filename);
+int db_export_csv_filtered(const ExpenseDB *db, const char *filename, const char *category,
+                           const char *from_date, const char *to_date,
+                           const char *substr_in_description);
 int db_import_csv(ExpenseDB *db, const char *filename);
+int db_import_csv_threads(ExpenseDB *db, const char *filename, int threads);
+
+/* read-only view of a snapshot that decodes pages of rows on demand,
+   keeping at most cache_bytes of them; NULL for v1 or damaged files */
+typedef struct LazyDB LazyDB;
+LazyDB *lazy_open(const char *filename, size_t cache_bytes);
+void lazy_close(LazyDB *lz);
+void lazy_list(LazyDB *lz);
+int lazy_print_by_id(LazyDB *lz, int id);
+void lazy_list_filtered(LazyDB *lz, const char *category, const char *from_date,
+                        const char *to_date, const char *substr_in_description);
+void lazy_monthly_summary(LazyDB *lz, const char *year_month);
+void lazy_print_stats(const LazyDB *lz);
 
 
 void db_monthly_summary(const ExpenseDB *db, const char *year_month);
+void db_monthly_summary_to(FILE *out, const ExpenseDB *db, const char *year_month);
+void db_all_months_summary(const ExpenseDB *db);
+/* YYYYMMDD keys of the first and last dated live rows; 0 when there are none */
+int db_date_span(const ExpenseDB *db, int *first_key, int *last_key);
+/* date-range totals from the per-day trees, O(log blocks + log DAY_BLOCK)
+   each however far apart the dates; NULL dates are open ends, NULL
+   category means all. 0 on a bad date or category */
+int db_range_total(const ExpenseDB *db, const char *category, const char *from_date,
+                   const char *to_date, long long *out);
+/* spend over the `window` days up to each step-th day from..to */
+int db_rolling_report(const ExpenseDB *db, const char *category, const char *from_date,
+                      const char *to_date, int window, int step);
+int db_aggregate(const ExpenseDB *db, int group_by, AggGroup **out);
+void db_print_aggregate(const ExpenseDB *db, int group_by);
 
 int is_valid_date(const char *d); 
-int parse_amount(const char *s, double *out);
+int parse_amount(const char *s, long long *out);
+
+/* amounts are exact cents; these convert at the edges */
+#define AMOUNT_BUF 24
+char *format_amount(long long cents, char *buf);    /* "-12.34" into AMOUNT_BUF bytes */
+long long amount_from_double(double v);             /* for files that stored doubles */
 
 #endif 
\ No newline at end of file
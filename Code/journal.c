@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "journal.h"
+#include "stats.h"
+
+#ifdef _WIN32
+  #include <io.h>
+  #define TRUNCATE(f, n) _chsize(_fileno(f), (long)(n))
+#else
+  #include <unistd.h>
+  #define TRUNCATE(f, n) ftruncate(fileno(f), (off_t)(n))
+#endif
+
+#define JOURNAL_MAX_PAYLOAD 2048
+#define JOURNAL_MAX_STR (DESCRIPTION_LEN - 1)
+
+typedef struct {
+    uint64_t seq;
+    uint32_t op;
+    uint32_t len;       /* payload bytes */
+    uint32_t crc;       /* CRC-32 of this head (crc = 0) and the payload */
+    uint32_t reserved;
+} JournalHead;
+
+typedef struct {
+    unsigned char buf[JOURNAL_MAX_PAYLOAD];
+    size_t len;
+} Record;
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t n) {
+    if (!crc_table[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (n--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t record_crc(JournalHead h, const unsigned char *payload) {
+    h.crc = 0;
+    return crc32_update(crc32_update(0, &h, sizeof h), payload, h.len);
+}
+
+/* data/expenses.bin -> data/expenses.journal */
+static int journal_path(const char *snapshot, char *out) {
+    size_t n = strlen(snapshot);
+    const char *dot = strrchr(snapshot, '.');
+    const char *slash = strrchr(snapshot, '/');
+    if (dot && (!slash || dot > slash)) n = (size_t)(dot - snapshot);
+    if (n + sizeof ".journal" > JOURNAL_PATH_LEN) return 0;
+    memcpy(out, snapshot, n);
+    memcpy(out + n, ".journal", sizeof ".journal");
+    return 1;
+}
+
+static void rec_bytes(Record *r, const void *p, size_t n) {
+    memcpy(r->buf + r->len, p, n);
+    r->len += n;
+}
+
+static void rec_int(Record *r, int32_t v) { rec_bytes(r, &v, sizeof v); }
+
+static void rec_str(Record *r, const char *s) {
+    size_t n = s ? strlen(s) : 0;
+    if (n > JOURNAL_MAX_STR) n = JOURNAL_MAX_STR;
+    uint16_t len = (uint16_t)n;
+    rec_bytes(r, &len, sizeof len);
+    if (n) rec_bytes(r, s, n);
+}
+
+static int take_bytes(const unsigned char **p, const unsigned char *end, void *out, size_t n) {
+    if ((size_t)(end - *p) < n) return 0;
+    memcpy(out, *p, n);
+    *p += n;
+    return 1;
+}
+
+/* copies a string field, truncating to cap */
+static int take_str(const unsigned char **p, const unsigned char *end, char *out, size_t cap) {
+    uint16_t n;
+    if (!take_bytes(p, end, &n, sizeof n) || (size_t)(end - *p) < n) return 0;
+    size_t c = n < cap ? n : cap - 1;
+    memcpy(out, *p, c);
+    out[c] = '\0';
+    *p += n;
+    return 1;
+}
+
+static void journal_append(ExpenseDB *db, uint32_t op, const Record *r) {
+    Journal *j = db->journal;
+    if (!j || !j->f || j->error) return;
+    JournalHead h;
+    memset(&h, 0, sizeof h);
+    h.seq = db->journal_seq + 1;
+    h.op = op;
+    h.len = (uint32_t)r->len;
+    h.crc = record_crc(h, r->buf);
+    if (fwrite(&h, sizeof h, 1, j->f) != 1 || (r->len && fwrite(r->buf, 1, r->len, j->f) != r->len)) {
+        j->error = 1;
+        return;
+    }
+    db->journal_seq = h.seq;
+    j->bytes += (long)(sizeof h + r->len);
+    STAT_COUNT(bytes_written, sizeof h + r->len);
+}
+
+void journal_log_add(ExpenseDB *db, const Expense *e) {
+    db->changes++;
+    if (!db->journal) return;
+    Record r;
+    r.len = 0;
+    rec_int(&r, e->id);
+    int64_t cents = e->amount;
+    rec_bytes(&r, &cents, sizeof cents);
+    rec_str(&r, e->date);
+    rec_str(&r, category_name(db, e->cat_id));
+    rec_str(&r, expense_description(db, e));
+    journal_append(db, JOP_ADD_CENTS, &r);
+}
+
+void journal_log_delete(ExpenseDB *db, int id) {
+    db->changes++;
+    if (!db->journal) return;
+    Record r;
+    r.len = 0;
+    rec_int(&r, id);
+    journal_append(db, JOP_DELETE, &r);
+}
+
+void journal_log_category(ExpenseDB *db, int op, const char *name, const char *newname) {
+    db->changes++;
+    if (!db->journal) return;
+    Record r;
+    r.len = 0;
+    rec_str(&r, name);
+    if (op == JOP_CAT_RENAME) rec_str(&r, newname);
+    journal_append(db, (uint32_t)op, &r);
+}
+
+/* logged as criteria, not ids, so a large delete stays one small record */
+void journal_log_delete_where(ExpenseDB *db, const char *category, const char *from_date,
+                              const char *to_date, const char *substr) {
+    db->changes++;
+    if (!db->journal) return;
+    Record r;
+    r.len = 0;
+    rec_int(&r, db->search_flags & SEARCH_IGNORE_CASE);
+    rec_str(&r, category);
+    rec_str(&r, from_date);
+    rec_str(&r, to_date);
+    rec_str(&r, substr);
+    journal_append(db, JOP_DELETE_WHERE, &r);
+}
+
+/* makes logged records durable; folds the journal into the snapshot once it
+   grows large, or after a failed write so nothing is left only in memory */
+int journal_commit(ExpenseDB *db) {
+    Journal *j = db->journal;
+    if (!j) return 1;
+    if (fflush(j->f) != 0) j->error = 1;
+    if (j->save_running) return 1; /* checkpoint on a later commit, after that save */
+    if (j->error || j->bytes >= JOURNAL_CHECKPOINT_BYTES) return db_save_binary(db, j->snapshot);
+    return 1;
+}
+
+static int journal_apply(ExpenseDB *db, const JournalHead *h, const unsigned char *p) {
+    const unsigned char *end = p + h->len;
+    char a[JOURNAL_MAX_STR + 1], b[JOURNAL_MAX_STR + 1], c[JOURNAL_MAX_STR + 1], d[JOURNAL_MAX_STR + 1];
+    int32_t id, flags;
+    switch (h->op) {
+    case JOP_ADD:
+    case JOP_ADD_CENTS: {
+        Expense e;
+        memset(&e, 0, sizeof e);
+        /* JOP_ADD came from builds that kept amounts as doubles */
+        double legacy = 0;
+        int64_t cents = 0;
+        if (!take_bytes(&p, end, &id, sizeof id) ||
+            !(h->op == JOP_ADD ? take_bytes(&p, end, &legacy, sizeof legacy)
+                               : take_bytes(&p, end, &cents, sizeof cents)) ||
+            !take_str(&p, end, e.date, sizeof e.date) || !take_str(&p, end, a, CAT_LEN) ||
+            !take_str(&p, end, d, sizeof d)) return 0;
+        e.amount = h->op == JOP_ADD ? amount_from_double(legacy) : cents;
+        e.cat_id = category_intern(db, a);
+        if (e.cat_id < 0) return 0;
+        /* reuse the logged id; the date index is sorted once after replay */
+        int next = db->next_id;
+        db->next_id = id;
+        db->by_date_sorted = 0;
+        int ok = db_add(db, e, d);
+        if (db->next_id < next) db->next_id = next;
+        return ok;
+    }
+    case JOP_DELETE:
+        if (!take_bytes(&p, end, &id, sizeof id)) return 0;
+        db_delete_by_id(db, id);
+        return 1;
+    case JOP_CAT_ADD:
+        if (!take_str(&p, end, a, sizeof a)) return 0;
+        return add_category(db, a);
+    case JOP_CAT_REMOVE:
+        if (!take_str(&p, end, a, sizeof a)) return 0;
+        remove_category(db, a);
+        return 1;
+    case JOP_CAT_RENAME:
+        if (!take_str(&p, end, a, sizeof a) || !take_str(&p, end, b, sizeof b)) return 0;
+        rename_category(db, a, b);
+        return 1;
+    case JOP_DELETE_WHERE: {
+        if (!take_bytes(&p, end, &flags, sizeof flags) || !take_str(&p, end, a, sizeof a) ||
+            !take_str(&p, end, b, sizeof b) || !take_str(&p, end, c, sizeof c) ||
+            !take_str(&p, end, d, sizeof d)) return 0;
+        int saved = db->search_flags;
+        db->search_flags = (saved & ~SEARCH_IGNORE_CASE) | (flags & SEARCH_IGNORE_CASE);
+        int n = db_delete_where(db, a[0] ? a : NULL, b[0] ? b : NULL, c[0] ? c : NULL, d[0] ? d : NULL);
+        /* only the case bit: a failed text index rebuild clears its own */
+        db->search_flags = (db->search_flags & ~SEARCH_IGNORE_CASE) | (saved & SEARCH_IGNORE_CASE);
+        return n >= 0;
+    }
+    }
+    return 1; /* unknown op from a newer build: skip it */
+}
+
+/* walks intact records from the start, applying those newer than
+   apply_to->journal_seq when apply_to is given. Returns the offset past
+   the last intact record; a torn or corrupt tail ends the walk. */
+static long journal_scan(FILE *f, ExpenseDB *apply_to, unsigned long long *last_seq, int *applied) {
+    unsigned char payload[JOURNAL_MAX_PAYLOAD];
+    long pos = 0;
+    JournalHead h;
+    if (fseek(f, 0, SEEK_SET) != 0) return -1;
+    while (fread(&h, sizeof h, 1, f) == 1) {
+        if (h.len > JOURNAL_MAX_PAYLOAD || fread(payload, 1, h.len, f) != h.len) break;
+        if (record_crc(h, payload) != h.crc) break;
+        if (h.seq > *last_seq) *last_seq = h.seq;
+        if (apply_to && h.seq > apply_to->journal_seq) {
+            if (!journal_apply(apply_to, &h, payload)) return -1;
+            apply_to->journal_seq = h.seq;
+            (*applied)++;
+        }
+        pos += (long)(sizeof h + h.len);
+    }
+    return pos;
+}
+
+/* replays the snapshot's journal into db; returns records applied, -1 on error */
+int journal_replay(ExpenseDB *db, const char *snapshot) {
+    char path[JOURNAL_PATH_LEN];
+    if (!journal_path(snapshot, path)) return 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    STAT_START(t0);
+    unsigned long long last = 0;
+    int applied = 0;
+    long end = journal_scan(f, db, &last, &applied);
+    fclose(f);
+    STAT_COUNT(bytes_read, end < 0 ? 0 : end);
+    STAT_STOP(SOP_JOURNAL_REPLAY, t0, applied);
+    return end < 0 ? -1 : applied;
+}
+
+/* bytes in the snapshot's journal, 0 when there is none */
+long journal_pending(const char *snapshot) {
+    char path[JOURNAL_PATH_LEN];
+    if (!journal_path(snapshot, path)) return 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    long n = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : 0;
+    fclose(f);
+    return n > 0 ? n : 0;
+}
+
+/* starts logging db's changes next to snapshot, after cutting off any torn tail */
+int journal_open(ExpenseDB *db, const char *snapshot) {
+    Journal *j = calloc(1, sizeof *j);
+    if (!j) return 0;
+    size_t n = strlen(snapshot);
+    if (n >= JOURNAL_PATH_LEN || !journal_path(snapshot, j->path)) { free(j); return 0; }
+    memcpy(j->snapshot, snapshot, n + 1);
+    j->f = fopen(j->path, "r+b");
+    if (!j->f) j->f = fopen(j->path, "w+b");
+    if (!j->f) { free(j); return 0; }
+    unsigned long long last = 0;
+    long end = journal_scan(j->f, NULL, &last, NULL);
+    if (end < 0 || fseek(j->f, 0, SEEK_END) != 0) { journal_close(j); return 0; }
+    if (ftell(j->f) > end) {
+        fflush(j->f);
+        if (TRUNCATE(j->f, end) != 0) { journal_close(j); return 0; }
+    }
+    if (fseek(j->f, end, SEEK_SET) != 0) { journal_close(j); return 0; }
+    j->bytes = end;
+    if (last > db->journal_seq) db->journal_seq = last;
+    if (db->journal) journal_close(db->journal);
+    db->journal = j;
+    return 1;
+}
+
+/* called once the snapshot holds everything logged so far */
+int journal_reset(Journal *j) {
+    if (fflush(j->f) != 0 || TRUNCATE(j->f, 0) != 0 || fseek(j->f, 0, SEEK_SET) != 0) {
+        j->error = 1;
+        return 0;
+    }
+    j->bytes = 0;
+    j->error = 0;
+    return 1;
+}
+
+void journal_close(Journal *j) {
+    if (!j) return;
+    if (j->f) fclose(j->f);
+    free(j);
+}
@@ -0,0 +1,42 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include "finance.h"
+
+#define JOURNAL_PATH_LEN 256
+#define JOURNAL_CHECKPOINT_BYTES (64L << 20)   /* fold into the snapshot past this */
+
+/* append-only log of changes made since the last snapshot */
+struct Journal {
+    FILE *f;
+    char path[JOURNAL_PATH_LEN];
+    char snapshot[JOURNAL_PATH_LEN];
+    long bytes;
+    int error;          /* a write failed; the next commit checkpoints */
+    int save_running;   /* a background save owns the snapshot; checkpoints wait */
+};
+
+int journal_open(ExpenseDB *db, const char *snapshot);
+void journal_close(Journal *j);
+int journal_reset(Journal *j);
+int journal_replay(ExpenseDB *db, const char *snapshot);
+long journal_pending(const char *snapshot);
+
+void journal_log_add(ExpenseDB *db, const Expense *e);
+void journal_log_delete(ExpenseDB *db, int id);
+void journal_log_category(ExpenseDB *db, int op, const char *name, const char *newname);
+void journal_log_delete_where(ExpenseDB *db, const char *category, const char *from_date,
+                              const char *to_date, const char *substr);
+int journal_commit(ExpenseDB *db);
+
+/* record ops */
+#define JOP_ADD        1    /* amount as a double; replay only */
+#define JOP_DELETE     2
+#define JOP_CAT_ADD    3
+#define JOP_CAT_REMOVE 4
+#define JOP_CAT_RENAME 5
+#define JOP_DELETE_WHERE 6
+#define JOP_ADD_CENTS  7    /* amount as int64 cents */
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <limits.h>
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #include <immintrin.h>
+  #define HAVE_AVX2_KERNEL 1
+#endif
+
+void col_stats_init(ColStats *s) {
+    s->count = 0;
+    s->sum = 0;
+    s->min = LLONG_MAX;
+    s->max = LLONG_MIN;
+}
+
+static void stats_add(ColStats *s, long long a) {
+    s->count++;
+    s->sum += a;
+    if (a < s->min) s->min = a;
+    if (a > s->max) s->max = a;
+}
+
+static int row_in(int k, int c, int cat_id, int from_key, int to_key) {
+    return (cat_id < 0 ? c >= 0 : c == cat_id) && k >= from_key && k <= to_key;
+}
+
+static void stats_scalar(const long long *amount, const int *key, const int *cat, size_t n,
+                         int cat_id, int from_key, int to_key, ColStats *out) {
+    for (size_t i = 0; i < n; ++i)
+        if (row_in(key[i], cat[i], cat_id, from_key, to_key)) stats_add(out, amount[i]);
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/* four rows per step: the 32-bit key/category tests give a lane mask that
+   is widened to 64 bits and applied to the amounts. AVX2 has no 64-bit
+   min/max, so those are a compare and blend. */
+__attribute__((target("avx2")))
+static void stats_avx2(const long long *amount, const int *key, const int *cat, size_t n,
+                       int cat_id, int from_key, int to_key, ColStats *out) {
+    const int keyed = from_key != INT_MIN || to_key != INT_MAX;
+    const __m128i vfrom = _mm_set1_epi32(from_key), vto = _mm_set1_epi32(to_key);
+    const __m128i vcat = _mm_set1_epi32(cat_id), none = _mm_set1_epi32(-1);
+    const __m256i top = _mm256_set1_epi64x(LLONG_MAX), bottom = _mm256_set1_epi64x(LLONG_MIN);
+    __m256i sum = _mm256_setzero_si256(), mn = top, mx = bottom;
+    long long count = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(cat + i));
+        __m128i ok = cat_id < 0 ? _mm_cmpgt_epi32(c, none) : _mm_cmpeq_epi32(c, vcat);
+        if (keyed) {
+            __m128i k = _mm_loadu_si128((const __m128i *)(key + i));
+            __m128i out_of_range = _mm_or_si128(_mm_cmpgt_epi32(vfrom, k), _mm_cmpgt_epi32(k, vto));
+            ok = _mm_andnot_si128(out_of_range, ok);
+        }
+        __m256i m = _mm256_cvtepi32_epi64(ok);
+        int bits = _mm256_movemask_pd(_mm256_castsi256_pd(m));
+        if (!bits) continue;
+        __m256i a = _mm256_loadu_si256((const __m256i *)(amount + i));
+        sum = _mm256_add_epi64(sum, _mm256_and_si256(m, a));
+        __m256i lo = _mm256_blendv_epi8(top, a, m), hi = _mm256_blendv_epi8(bottom, a, m);
+        mn = _mm256_blendv_epi8(mn, lo, _mm256_cmpgt_epi64(mn, lo));
+        mx = _mm256_blendv_epi8(mx, hi, _mm256_cmpgt_epi64(hi, mx));
+        count += __builtin_popcount((unsigned)bits);
+    }
+    long long s[4], lo[4], hi[4];
+    _mm256_storeu_si256((__m256i *)s, sum);
+    _mm256_storeu_si256((__m256i *)lo, mn);
+    _mm256_storeu_si256((__m256i *)hi, mx);
+    out->count += count;
+    out->sum += s[0] + s[1] + s[2] + s[3];
+    for (int l = 0; l < 4; ++l) {
+        if (lo[l] < out->min) out->min = lo[l];
+        if (hi[l] > out->max) out->max = hi[l];
+    }
+    stats_scalar(amount + i, key + i, cat + i, n - i, cat_id, from_key, to_key, out);
+}
+#endif
+
+typedef void (*StatsFn)(const long long *, const int *, const int *, size_t, int, int, int, ColStats *);
+
+static StatsFn stats_fn;
+
+/* FINANCE_SIMD=0 forces the scalar kernel */
+static StatsFn pick_kernel(void) {
+    if (!stats_fn) {
+        const char *env = getenv("FINANCE_SIMD");
+        stats_fn = stats_scalar;
+#ifdef HAVE_AVX2_KERNEL
+        __builtin_cpu_init();
+        if (!(env && env[0] == '0') && __builtin_cpu_supports("avx2")) stats_fn = stats_avx2;
+#else
+        (void)env;
+#endif
+    }
+    return stats_fn;
+}
+
+void col_stats(const long long *amount, const int *key, const int *cat, size_t n,
+               int cat_id, int from_key, int to_key, ColStats *out) {
+    pick_kernel()(amount, key, cat, n, cat_id, from_key, to_key, out);
+}
+
+const char *col_kernel_name(void) {
+    return pick_kernel() == stats_scalar ? "scalar" : "avx2";
+}
+
+/* a scatter into per-category totals doesn't vectorize usefully; this is
+   still one tight pass over 12 bytes a row */
+void col_stats_by_cat(const long long *amount, const int *cat, size_t n, int ncat, ColStats *per) {
+    for (size_t i = 0; i < n; ++i) {
+        int c = cat[i];
+        if (c >= 0 && c < ncat) stats_add(&per[c], amount[i]);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+
+typedef struct {
+    long long count;
+    long long sum, min, max;    /* cents; min/max are LLONG_MAX/MIN while count is 0 */
+} ColStats;
+
+/* stats over rows [0, n) of the hot columns whose key lies in
+   [from_key, to_key] and whose category is cat_id (-1 = any); rows with
+   cat < 0 are deleted and never match. Integer sums, so the AVX2 and
+   scalar kernels agree exactly; AVX2 is used when the CPU has it. */
+void col_stats(const long long *amount, const int *key, const int *cat, size_t n,
+               int cat_id, int from_key, int to_key, ColStats *out);
+
+/* per-category stats for rows [0, n); per has ncat entries and is added to */
+void col_stats_by_cat(const long long *amount, const int *cat, size_t n, int ncat, ColStats *per);
+
+void col_stats_init(ColStats *s);
+const char *col_kernel_name(void);
+
+#endif
@@ -2,20 +2,73 @@
 #include <string.h>
 #include <stdlib.h>
 #include "finance.h"
+#include "autosave.h"
+#include "batch.h"
+#include "server.h"
+#include "stats.h"
 
-static void print_menu(void)
+#define DB_FILE "data/expenses.bin"
+#define SHARD_DIR "data/shards"
+#define LAZY_CACHE_MB 64
+#define AUTOSAVE_SECONDS 60
+#define AUTOSAVE_CHANGES 100
+#define LOADGEN_CLIENTS 8
+#define LOADGEN_REQUESTS 10000
+#define LOADGEN_WRITE_PCT 10
+
+/* where the DB lives: one snapshot file, or per-month shards (--sharded) */
+typedef struct
+{
+    int sharded;
+    const char *from, *to; /* MM-YYYY window for --sharded, NULL = open */
+    int lazy;              /* browse the snapshot read-only first (--lazy) */
+    size_t cache_mb;
+    int autosave_secs;     /* background saves (--autosave); 0 = off */
+    int autosave_changes;
+} Storage;
+
+/* the background saver, or NULL. It copies the DB whenever the foreground
+   does not hold it, so only changes to the DB are bracketed with
+   autosave_hold/autosave_release, never a prompt */
+static Autosave *saver;
+
+static const char *storage_name(const Storage *st)
+{
+    return st->sharded ? SHARD_DIR : DB_FILE;
+}
+
+static int storage_save(ExpenseDB *db, const Storage *st)
+{
+    return st->sharded ? db_save_sharded(db, SHARD_DIR) : db_save_binary(db, DB_FILE);
+}
+
+static int storage_load(ExpenseDB *db, const Storage *st)
+{
+    return st->sharded ? db_load_sharded(db, SHARD_DIR, st->from, st->to) : db_load_binary(db, DB_FILE);
+}
+
+static void print_menu(const char *store)
 {
     puts("\n--- Personal Finance Tracker ---");
     puts("1. Add expense");
     puts("2. List all expenses (grouped + detailed)");
     puts("3. Delete expense by ID");
-    puts("4. Save DB (data/expenses.bin)");
-    puts("5. Load DB (data/expenses.bin)");
+    puts("11. Delete all expenses matching a filter");
+    printf("4. Save DB (%s)\n", store);
+    printf("5. Load DB (%s)\n", store);
     puts("6. Export CSV (data/export.csv)");
+    puts("14. Export filtered CSV (ask filename)");
     puts("7. Import CSV (ask filename)");
     puts("8. Monthly summary (MM-YYYY)");
+    puts("12. Summary of all months");
+    puts("13. Group report (by category / month / year)");
     puts("9. Manage categories");
     puts("10. Search / Filter expenses");
+    puts("15. Search settings (ignore case / text index)");
+    puts("16. Storage encoding (columns / packed / packed+LZ)");
+    puts("17. Performance stats (timings, rows, bytes)");
+    puts("18. Range total and rolling spend");
+    puts("19. Largest expenses and percentiles");
     puts("0. Exit");
     printf("Choose: ");
 }
@@ -28,7 +81,15 @@ static void read_line(const char *prompt, char *buf, int n)
         buf[0] = 0;
         return;
     }
-    buf[strcspn(buf, "\n")] = 0;
+    size_t len = strcspn(buf, "\n");
+    if (buf[len] == '\0')
+    {
+        /* line longer than the buffer: drop the rest so it doesn't leak into the next prompt */
+        int c;
+        while ((c = getchar()) != '\n' && c != EOF)
+            ;
+    }
+    buf[len] = 0;
 }
 
 static void manage_categories(ExpenseDB *db)
@@ -56,17 +117,26 @@ static void manage_categories(ExpenseDB *db)
             read_line("New category name: ", name, sizeof name);
             if (name[0] == '\0')
                 puts("Empty name.");
-            else if (add_category(db, name))
-                printf("Added \"%s\"\n", name);
             else
-                puts("Failed to add (maybe exists or limit).");
+            {
+                autosave_hold(saver);
+                int ok = add_category(db, name);
+                autosave_release(saver);
+                if (ok)
+                    printf("Added \"%s\"\n", name);
+                else
+                    puts("Failed to add (maybe exists or limit).");
+            }
         }
         else if (ch == 3)
         {
             char oldn[CAT_LEN], newn[CAT_LEN];
             read_line("Existing category name: ", oldn, sizeof oldn);
             read_line("New name: ", newn, sizeof newn);
-            if (rename_category(db, oldn, newn))
+            autosave_hold(saver);
+            int ok = rename_category(db, oldn, newn);
+            autosave_release(saver);
+            if (ok)
                 printf("Renamed %s -> %s\n", oldn, newn);
             else
                 puts("Rename failed (check names).");
@@ -75,7 +145,10 @@ static void manage_categories(ExpenseDB *db)
         {
             char name[CAT_LEN];
             read_line("Category to remove: ", name, sizeof name);
-            if (remove_category(db, name))
+            autosave_hold(saver);
+            int ok = remove_category(db, name);
+            autosave_release(saver);
+            if (ok)
                 printf("Removed \"%s\"\n", name);
             else
                 puts("Remove failed (maybe in use or not exist).");
@@ -87,47 +160,426 @@ static void manage_categories(ExpenseDB *db)
     }
 }
 
-static void search_filter_ui(ExpenseDB *db)
+typedef struct
 {
-    char cat[CAT_LEN] = {0};
-    char from[DATE_LEN] = {0};
-    char to[DATE_LEN] = {0};
-    char substr[DESCRIPTION_LEN] = {0};
-    read_line("Filter by category (leave empty to ignore): ", cat, sizeof cat);
-    read_line("From date (DD-MM-YYYY, leave empty to ignore): ", from, sizeof from);
-    read_line("To date (DD-MM-YYYY, leave empty to ignore): ", to, sizeof to);
-    read_line("Search text in description (leave empty to ignore): ", substr, sizeof substr);
-    if (from[0] && !is_valid_date(from))
+    char cat[CAT_LEN];
+    char from[DATE_LEN];
+    char to[DATE_LEN];
+    char substr[DESCRIPTION_LEN];
+} FilterInput;
+
+static int read_filter(FilterInput *fi)
+{
+    memset(fi, 0, sizeof *fi);
+    read_line("Filter by category (leave empty to ignore): ", fi->cat, sizeof fi->cat);
+    read_line("From date (DD-MM-YYYY, leave empty to ignore): ", fi->from, sizeof fi->from);
+    read_line("To date (DD-MM-YYYY, leave empty to ignore): ", fi->to, sizeof fi->to);
+    read_line("Search text in description (leave empty to ignore): ", fi->substr, sizeof fi->substr);
+    if (fi->from[0] && !is_valid_date(fi->from))
     {
         puts("From date invalid.");
-        return;
+        return 0;
     }
-    if (to[0] && !is_valid_date(to))
+    if (fi->to[0] && !is_valid_date(fi->to))
     {
         puts("To date invalid.");
+        return 0;
+    }
+    return 1;
+}
+
+static void search_filter_ui(ExpenseDB *db)
+{
+    FilterInput fi;
+    if (!read_filter(&fi))
+        return;
+    db_list_filtered(db, fi.cat[0] ? fi.cat : NULL, fi.from[0] ? fi.from : NULL,
+                     fi.to[0] ? fi.to : NULL, fi.substr[0] ? fi.substr : NULL);
+}
+
+static int ask_yes_no(const char *prompt)
+{
+    char resp[8];
+    read_line(prompt, resp, sizeof resp);
+    return resp[0] == 'y' || resp[0] == 'Y';
+}
+
+static void search_settings_ui(ExpenseDB *db)
+{
+    printf("Ignore case: %s, text index: %s\n",
+           (db->search_flags & SEARCH_IGNORE_CASE) ? "on" : "off",
+           (db->search_flags & SEARCH_TEXT_INDEX) ? "on" : "off");
+    int flags = 0;
+    if (ask_yes_no("Ignore case in description search? (y/n): "))
+        flags |= SEARCH_IGNORE_CASE;
+    if (ask_yes_no("Keep a text index for faster search? (y/n): "))
+        flags |= SEARCH_TEXT_INDEX;
+    autosave_hold(saver);
+    int ok = db_set_search_flags(db, flags);
+    autosave_release(saver);
+    if (!ok)
+        puts("Not enough memory for the text index; searching without it.");
+    else
+        puts("Search settings updated.");
+}
+
+static void encoding_ui(ExpenseDB *db)
+{
+    static const char *names[] = {"columns", "packed", "packed+LZ"};
+    printf("Current encoding: %s\n", names[db->encoding]);
+    puts("0. Columns (largest, fastest to load)");
+    puts("1. Packed (varints and deltas)");
+    puts("2. Packed + LZ (smallest)");
+    char buf[16];
+    read_line("Choose: ", buf, sizeof buf);
+    autosave_hold(saver);
+    int ok = buf[0] >= '0' && buf[0] <= '2' && db_set_encoding(db, buf[0] - '0');
+    autosave_release(saver);
+    if (!ok)
+        puts("Invalid.");
+    else
+        printf("Encoding set to %s; used from the next save.\n", names[db->encoding]);
+}
+
+static void stats_ui(void)
+{
+    stats_print(stdout);
+    if (ask_yes_no("Reset the counters? (y/n): "))
+    {
+        stats_reset();
+        puts("Counters reset.");
+    }
+}
+
+static void range_report_ui(ExpenseDB *db)
+{
+    char cat[CAT_LEN], from[DATE_LEN], to[DATE_LEN], buf[16], amt[AMOUNT_BUF];
+    read_line("Category (leave empty for all): ", cat, sizeof cat);
+    read_line("From date (DD-MM-YYYY, leave empty for the first expense): ", from, sizeof from);
+    read_line("To date (DD-MM-YYYY, leave empty for the last expense): ", to, sizeof to);
+    long long total;
+    if (!db_range_total(db, cat, from, to, &total))
+    {
+        puts("Unknown category or invalid date.");
+        return;
+    }
+    printf("Total spent: %s\n", format_amount(total, amt));
+    read_line("Rolling window in days (leave empty to skip): ", buf, sizeof buf);
+    int window = atoi(buf);
+    if (window <= 0)
+        return;
+    read_line("One line every how many days? (default 1): ", buf, sizeof buf);
+    int step = atoi(buf) > 0 ? atoi(buf) : 1;
+    db_rolling_report(db, cat, from, to, window, step);
+}
+
+static void top_report_ui(ExpenseDB *db)
+{
+    FilterInput fi;
+    if (!read_filter(&fi))
+        return;
+    char buf[16];
+    read_line("How many of the largest? (default 10): ", buf, sizeof buf);
+    int k = atoi(buf) > 0 ? atoi(buf) : 10;
+    read_line("Per category or month? (c/m, leave empty for overall): ", buf, sizeof buf);
+    int by = (buf[0] == 'c' || buf[0] == 'C') ? GROUP_CATEGORY : (buf[0] == 'm' || buf[0] == 'M') ? GROUP_MONTH : 0;
+    const char *cat = fi.cat[0] ? fi.cat : NULL, *from = fi.from[0] ? fi.from : NULL;
+    const char *to = fi.to[0] ? fi.to : NULL, *text = fi.substr[0] ? fi.substr : NULL;
+    db_print_top_k(db, cat, from, to, text, k, by);
+    puts("");
+    db_print_percentiles(db, cat, from, to, text);
+}
+
+static void group_report_ui(ExpenseDB *db)
+{
+    char how[16];
+    read_line("Group by (c=category, m=month, y=year; combine e.g. cm): ", how, sizeof how);
+    int flags = 0;
+    for (char *p = how; *p; ++p)
+    {
+        if (*p == 'c' || *p == 'C')
+            flags |= GROUP_CATEGORY;
+        else if (*p == 'm' || *p == 'M')
+            flags |= GROUP_MONTH;
+        else if (*p == 'y' || *p == 'Y')
+            flags |= GROUP_YEAR;
+    }
+    if (flags == 0)
+    {
+        puts("Nothing to group by.");
+        return;
+    }
+    db_print_aggregate(db, flags);
+}
+
+static void export_filtered_ui(ExpenseDB *db)
+{
+    FilterInput fi;
+    if (!read_filter(&fi))
+        return;
+    char filename[256];
+    read_line("Export to (default data/export.csv): ", filename, sizeof filename);
+    if (filename[0] == '\0')
+        strcpy(filename, "data/export.csv");
+    if (db_export_csv_filtered(db, filename, fi.cat[0] ? fi.cat : NULL, fi.from[0] ? fi.from : NULL,
+                               fi.to[0] ? fi.to : NULL, fi.substr[0] ? fi.substr : NULL))
+        printf("Exported to %s\n", filename);
+    else
+        puts("Export failed.");
+}
+
+/* read-only browsing of the snapshot, paging rows in as queries need them.
+   Returns 1 when the user asks to load the DB in full for editing. */
+static int lazy_session(const char *file, size_t cache_mb)
+{
+    LazyDB *lz = lazy_open(file, cache_mb << 20);
+    if (!lz)
+    {
+        printf("Cannot open %s lazily (missing, old format or damaged); loading it in full.\n", file);
+        return 1;
+    }
+    lazy_print_stats(lz);
+    char tmp[512];
+    int choice;
+    do
+    {
+        printf("\n--- Personal Finance Tracker (read-only, %s) ---\n", file);
+        puts("1. List all expenses");
+        puts("2. Show expense by ID");
+        puts("3. Search / Filter expenses");
+        puts("4. Monthly summary (MM-YYYY)");
+        puts("5. Page cache statistics");
+        puts("6. Load in full for editing");
+        puts("0. Exit");
+        printf("Choose: ");
+        if (!fgets(tmp, sizeof tmp, stdin))
+            break;
+        choice = atoi(tmp);
+        if (choice == 1)
+        {
+            lazy_list(lz);
+        }
+        else if (choice == 2)
+        {
+            read_line("Enter ID: ", tmp, sizeof tmp);
+            if (!lazy_print_by_id(lz, atoi(tmp)))
+                puts("ID not found.");
+        }
+        else if (choice == 3)
+        {
+            FilterInput fi;
+            if (read_filter(&fi))
+                lazy_list_filtered(lz, fi.cat[0] ? fi.cat : NULL, fi.from[0] ? fi.from : NULL,
+                                   fi.to[0] ? fi.to : NULL, fi.substr[0] ? fi.substr : NULL);
+        }
+        else if (choice == 4)
+        {
+            read_line("Enter month (MM-YYYY): ", tmp, sizeof tmp);
+            lazy_monthly_summary(lz, tmp);
+        }
+        else if (choice == 5)
+        {
+            lazy_print_stats(lz);
+        }
+        else if (choice == 6)
+        {
+            lazy_close(lz);
+            return 1;
+        }
+        else if (choice != 0)
+        {
+            puts("Invalid option.");
+        }
+    } while (choice != 0);
+    lazy_close(lz);
+    return 0;
+}
+
+static void bulk_delete_ui(ExpenseDB *db)
+{
+    FilterInput fi;
+    if (!read_filter(&fi))
+        return;
+    if (!fi.cat[0] && !fi.from[0] && !fi.to[0] && !fi.substr[0])
+    {
+        puts("Give at least one criterion (use option 3 for single rows).");
+        return;
+    }
+    char resp[8];
+    printf("Delete every matching expense? (y/n): ");
+    if (!fgets(resp, sizeof resp, stdin) || (resp[0] != 'y' && resp[0] != 'Y'))
+    {
+        puts("Cancelled.");
         return;
     }
-    db_list_filtered(db, cat[0] ? cat : NULL, from[0] ? from : NULL, to[0] ? to : NULL, substr[0] ? substr : NULL);
+    autosave_hold(saver);
+    int n = db_delete_where(db, fi.cat[0] ? fi.cat : NULL, fi.from[0] ? fi.from : NULL,
+                            fi.to[0] ? fi.to : NULL, fi.substr[0] ? fi.substr : NULL);
+    autosave_release(saver);
+    if (n < 0)
+        puts("Delete failed (memory).");
+    else
+        printf("Deleted %d expense(s).\n", n);
 }
 
-int main(void)
+/* loads once, runs the commands from the file and then argv, and saves
+   once if anything changed. Nothing is journaled meanwhile: a failed run
+   exits without saving and leaves the DB on disk as it was. */
+static int batch_session(const Storage *st, const char *file, int argc, char **argv)
 {
     ExpenseDB db;
     db_init(&db);
+    if (!storage_load(&db, st) && st->sharded)
+        db_load_binary(&db, DB_FILE);
+    /* results are read by scripts, not watched */
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    unsigned long long loaded = db.changes;
+    int n = 0, ran = 0;
+    if (file && (n = batch_run_file(&db, file)) >= 0)
+        ran = n;
+    if (n >= 0 && argc > 0 && (n = batch_run_args(&db, argc, argv)) >= 0)
+        ran += n;
+    int ok = n >= 0;
+    if (!ok)
+    {
+        fflush(stdout);
+        fputs("Batch stopped; nothing saved.\n", stderr);
+    }
+    else if (db.changes != loaded)
+    {
+        /* attached only now so the save also empties a leftover journal */
+        if (!st->sharded)
+            db_journal_attach(&db, DB_FILE);
+        ok = storage_save(&db, st);
+        if (ok)
+            printf("%d command(s) run, saved to %s\n", ran, storage_name(st));
+        else
+            fprintf(stderr, "Save to %s failed.\n", storage_name(st));
+    }
+    else
+    {
+        printf("%d command(s) run, nothing to save\n", ran);
+    }
+    db_free(&db);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    stats_dump_at_exit();
+    Storage st = {0, NULL, NULL, 0, LAZY_CACHE_MB, AUTOSAVE_SECONDS, AUTOSAVE_CHANGES};
+    int serving = 0, loading = 0, load[3] = {LOADGEN_CLIENTS, LOADGEN_REQUESTS, LOADGEN_WRITE_PCT};
+    const char *sock = SERVER_SOCKET;
+    const char *batch_file = NULL;
+    int batch_at = 0; /* argv index of the first batch command */
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--sharded") == 0)
+        {
+            st.sharded = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && !batch_is_command(argv[i + 1]))
+                st.from = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-' && !batch_is_command(argv[i + 1]))
+                st.to = argv[++i];
+        }
+        else if (strcmp(argv[i], "--lazy") == 0)
+        {
+            st.lazy = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && atoi(argv[i + 1]) > 0)
+                st.cache_mb = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--autosave") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        {
+            st.autosave_secs = atoi(argv[++i]);
+            st.autosave_changes = 0;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                st.autosave_changes = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--serve") == 0)
+        {
+            serving = 1;
+        }
+        else if (strcmp(argv[i], "--loadgen") == 0)
+        {
+            loading = 1;
+            /* clients, requests per client, % writes */
+            for (int k = 0; k < 3 && i + 1 < argc && argv[i + 1][0] != '-'; ++k)
+                load[k] = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+        {
+            sock = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batch_file = argv[++i];
+        }
+        else if (batch_is_command(argv[i]))
+        {
+            batch_at = i;
+            break;
+        }
+        else
+        {
+            st.sharded = -1;
+            break;
+        }
+    }
+    int batch = batch_file || batch_at;
+    if (st.sharded < 0 || (st.sharded && st.lazy) || (serving && (st.sharded || st.lazy || loading)) ||
+        (batch && (st.lazy || serving || loading)) || load[0] <= 0 || load[1] <= 0 || load[2] < 0 || load[2] > 100)
+    {
+        fprintf(stderr, "usage: %s [--sharded [FROM_MM-YYYY [TO_MM-YYYY]] | --lazy [CACHE_MB]] [--autosave SECONDS [CHANGES]]\n"
+                        "       %s [--sharded [FROM_MM-YYYY [TO_MM-YYYY]]] [--batch FILE] [COMMAND ...]\n"
+                        "       %s --serve [--socket PATH]\n"
+                        "       %s --loadgen [CLIENTS [REQUESTS [WRITE_PCT]]] [--socket PATH]\n",
+                argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (batch)
+        return batch_session(&st, batch_file, batch_at ? argc - batch_at : 0, argv + batch_at);
+    if (loading)
+        return loadgen(sock, load[0], load[1], load[2]) ? 0 : 1;
+    if (st.lazy && !lazy_session(DB_FILE, st.cache_mb))
+        return 0;
+
+    ExpenseDB db;
+    db_init(&db);
 
-    db_load_binary(&db, "data/expenses.bin");
+    if (st.sharded)
+    {
+        /* first sharded run: carry over the single-file DB */
+        if (!storage_load(&db, &st))
+            db_load_binary(&db, DB_FILE);
+    }
+    else
+    {
+        db_load_binary(&db, DB_FILE);
+        if (!db_journal_attach(&db, DB_FILE))
+            puts("Warning: cannot open data/expenses.journal; changes are only kept when saved.");
+        if (serving)
+        {
+            int ok = serve(&db, DB_FILE, sock);
+            db_free(&db);
+            return ok ? 0 : 1;
+        }
+        /* shard saves track dirty months in db itself, so they stay in the foreground */
+        saver = autosave_start(&db, DB_FILE, st.autosave_secs, st.autosave_changes);
+    }
 
     int choice;
     char tmp[512];
     do
     {
-        print_menu();
+        autosave_poll(saver);
+        print_menu(storage_name(&st));
         if (!fgets(tmp, sizeof tmp, stdin))
             break;
         choice = atoi(tmp);
         if (choice == 1)
         {
             Expense e;
+            char cat[CAT_LEN];
             memset(&e, 0, sizeof e);
 
             while (1)
@@ -140,20 +592,20 @@ int main(void)
 
             while (1)
             {
-                read_line("Category: ", e.category, sizeof e.category);
-                if (e.category[0] == '\0')
+                read_line("Category: ", cat, sizeof cat);
+                if (cat[0] == '\0')
                 {
                     printf("Category cannot be empty. Try again.\n");
                     continue;
                 }
-                if (category_exists(&db, e.category))
+                if (category_exists(&db, cat))
                 {
                     break;
                 }
                 else
                 {
                     char resp[8];
-                    printf("Category \"%s\" not found. Create it? (y/n): ", e.category);
+                    printf("Category \"%s\" not found. Create it? (y/n): ", cat);
                     if (!fgets(resp, sizeof resp, stdin))
                     {
                         resp[0] = 'n';
@@ -161,14 +613,17 @@ int main(void)
                     }
                     if (resp[0] == 'y' || resp[0] == 'Y')
                     {
-                        if (add_category(&db, e.category))
+                        autosave_hold(saver);
+                        int ok = add_category(&db, cat);
+                        autosave_release(saver);
+                        if (ok)
                         {
-                            printf("Category \"%s\" created.\n", e.category);
+                            printf("Category \"%s\" created.\n", cat);
                             break;
                         }
                         else
                         {
-                            puts("Failed to create category (limit reached). Choose another.");
+                            puts("Failed to create category. Choose another.");
                             continue;
                         }
                     }
@@ -179,12 +634,13 @@ int main(void)
                     }
                 }
             }
+            e.cat_id = category_find(&db, cat);
 
             while (1)
             {
                 char amtbuf[64];
                 read_line("Amount: ", amtbuf, sizeof amtbuf);
-                double v;
+                long long v;
                 if (!parse_amount(amtbuf, &v))
                 {
                     puts("Invalid amount. Enter a non-negative number (e.g. 150.50).");
@@ -194,9 +650,16 @@ int main(void)
                 break;
             }
 
-            read_line("Description: ", e.description, sizeof e.description);
+            /* one byte spare tells a description that was too long */
+            char desc[DESCRIPTION_LEN + 1];
+            read_line("Description: ", desc, sizeof desc);
+            if (strlen(desc) > DESCRIPTION_LEN - 1)
+                printf("Description cut to its first %d characters.\n", DESCRIPTION_LEN - 1);
 
-            if (db_add(&db, e))
+            autosave_hold(saver);
+            int ok = db_add(&db, e, desc);
+            autosave_release(saver);
+            if (ok)
                 printf("Added expense id %d\n", db.next_id - 1);
             else
                 puts("Failed to add expense (memory).");
@@ -212,22 +675,40 @@ int main(void)
             char idbuf[32];
             read_line("Enter ID to delete: ", idbuf, sizeof idbuf);
             int id = atoi(idbuf);
-            if (db_delete_by_id(&db, id))
+            autosave_hold(saver);
+            int ok = db_delete_by_id(&db, id);
+            autosave_release(saver);
+            if (ok)
                 puts("Deleted.");
             else
                 puts("ID not found.");
         }
+        else if (choice == 11)
+        {
+            bulk_delete_ui(&db);
+        }
+        else if (choice == 4 && saver)
+        {
+            autosave_request(saver);
+            printf("Saving to %s in the background.\n", storage_name(&st));
+        }
         else if (choice == 4)
         {
-            if (db_save_binary(&db, "data/expenses.bin"))
-                puts("Saved to data/expenses.bin");
+            if (storage_save(&db, &st))
+                printf("Saved to %s\n", storage_name(&st));
             else
                 puts("Save failed.");
         }
         else if (choice == 5)
         {
-            if (db_load_binary(&db, "data/expenses.bin"))
-                puts("Loaded data/expenses.bin");
+            /* checked under the hold, so no save can start in between */
+            autosave_hold(saver);
+            int busy = autosave_busy(saver), ok = !busy && storage_load(&db, &st);
+            autosave_release(saver);
+            if (busy)
+                puts("A save is still running; try again in a moment.");
+            else if (ok)
+                printf("Loaded %s\n", storage_name(&st));
             else
                 puts("Load failed or file missing.");
         }
@@ -238,13 +719,20 @@ int main(void)
             else
                 puts("Export failed.");
         }
+        else if (choice == 14)
+        {
+            export_filtered_ui(&db);
+        }
         else if (choice == 7)
         {
             char filename[256];
             read_line("Enter CSV filename to import (e.g. data/sample_import.csv): ", filename, sizeof filename);
             if (filename[0] == '\0')
                 strcpy(filename, "data/sample_import.csv");
-            if (db_import_csv(&db, filename))
+            autosave_hold(saver);
+            int ok = db_import_csv(&db, filename);
+            autosave_release(saver);
+            if (ok)
                 printf("Imported %s\n", filename);
             else
                 printf("Import failed: %s\n", filename);
@@ -255,6 +743,14 @@ int main(void)
             read_line("Enter month-year (MM-YYYY): ", ym, sizeof ym);
             db_monthly_summary(&db, ym);
         }
+        else if (choice == 12)
+        {
+            db_all_months_summary(&db);
+        }
+        else if (choice == 13)
+        {
+            group_report_ui(&db);
+        }
         else if (choice == 9)
         {
             manage_categories(&db);
@@ -263,10 +759,31 @@ int main(void)
         {
             search_filter_ui(&db);
         }
+        else if (choice == 15)
+        {
+            search_settings_ui(&db);
+        }
+        else if (choice == 16)
+        {
+            encoding_ui(&db);
+        }
+        else if (choice == 17)
+        {
+            stats_ui();
+        }
+        else if (choice == 18)
+        {
+            range_report_ui(&db);
+        }
+        else if (choice == 19)
+        {
+            top_report_ui(&db);
+        }
         else if (choice == 0)
         {
-            puts("Exiting. Auto-saving to data/expenses.bin");
-            db_save_binary(&db, "data/expenses.bin");
+            printf("Exiting. Auto-saving to %s\n", storage_name(&st));
+            if (!saver)
+                storage_save(&db, &st);
         }
         else
         {
@@ -274,6 +791,9 @@ int main(void)
         }
     } while (choice != 0);
 
+    /* waits for a save in flight, then writes whatever is still unsaved */
+    autosave_stop(saver);
+
     db_free(&db);
     return 0;
 }
@@ -0,0 +1,227 @@
+#include <string.h>
+#include <stdint.h>
+#include "pack.h"
+
+/* ---- varints ---- */
+
+static unsigned char *put_varint(unsigned char *p, uint64_t v) {
+    while (v >= 0x80) { *p++ = (unsigned char)(v | 0x80); v >>= 7; }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint64_t *v) {
+    uint64_t r = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char c = *p++;
+        r |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) { *v = r; return p; }
+    }
+    return NULL;
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+/* ---- row blocks ---- */
+
+size_t pack_bound(int n) {
+    /* id, key, amount, category, length, text */
+    return (size_t)n * (10 + 10 + 10 + 5 + 5 + DESCRIPTION_LEN);
+}
+
+#define SLOT(i) (slots ? slots[first + (i)] : first + (i))
+
+size_t pack_rows(const ExpenseDB *db, const int *slots, int first, int n, unsigned char *out) {
+    const Expense *arr = db->arr;
+    unsigned char *p = out;
+    int64_t prev = 0;
+    for (int i = 0; i < n; ++i) {
+        int64_t id = arr[SLOT(i)].id;
+        p = put_varint(p, zigzag(id - prev));
+        prev = id;
+    }
+    prev = 0;
+    for (int i = 0; i < n; ++i) {
+        int64_t k = arr[SLOT(i)].date_key;
+        p = put_varint(p, zigzag(k - prev));
+        prev = k;
+    }
+    for (int i = 0; i < n; ++i) p = put_varint(p, zigzag(arr[SLOT(i)].amount));
+    for (int i = 0; i < n; ++i) p = put_varint(p, (uint64_t)arr[SLOT(i)].cat_id);
+    for (int i = 0; i < n; ++i) p = put_varint(p, arr[SLOT(i)].desc_len);
+    for (int i = 0; i < n; ++i) {
+        const Expense *e = &arr[SLOT(i)];
+        memcpy(p, expense_description(db, e), e->desc_len);
+        p += e->desc_len;
+    }
+    return (size_t)(p - out);
+}
+
+/* fills id, date_key, amount, cat_id and desc_len as stored, and points
+   *text at the descriptions, back to back; 0 on a malformed block. legacy
+   blocks (version 2 files) tag each amount: even = cents << 1, odd = a raw
+   double follows. */
+int unpack_rows(const unsigned char *raw, size_t len, Expense *out, int n, int legacy, const char **text) {
+    const unsigned char *p = raw, *end = raw + len;
+    uint64_t v;
+    int64_t prev = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!(p = get_varint(p, end, &v))) return 0;
+        prev += unzigzag(v);
+        if (prev <= 0 || prev > INT32_MAX) return 0;
+        out[i].id = (int)prev;
+    }
+    prev = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!(p = get_varint(p, end, &v))) return 0;
+        prev += unzigzag(v);
+        if (prev < INT32_MIN || prev > INT32_MAX) return 0;
+        out[i].date_key = (int)prev;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (!(p = get_varint(p, end, &v))) return 0;
+        if (!legacy) {
+            out[i].amount = unzigzag(v);
+        } else if (v & 1) {
+            double d;
+            if ((size_t)(end - p) < sizeof d) return 0;
+            memcpy(&d, p, sizeof d);
+            p += sizeof d;
+            out[i].amount = amount_from_double(d);
+        } else {
+            out[i].amount = unzigzag(v >> 1);
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        if (!(p = get_varint(p, end, &v)) || v > INT32_MAX) return 0;
+        out[i].cat_id = (int)v;
+    }
+    size_t total = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!(p = get_varint(p, end, &v)) || v > len) return 0;
+        out[i].desc_len = (unsigned)v;
+        total += (size_t)v;
+    }
+    if (total > (size_t)(end - p)) return 0;
+    *text = (const char *)p;
+    return 1;
+}
+
+/* ---- codecs ---- */
+
+static size_t none_bound(size_t n) { return n; }
+
+static size_t none_compress(const unsigned char *src, size_t n, unsigned char *dst) {
+    memcpy(dst, src, n);
+    return n;
+}
+
+static int none_decompress(const unsigned char *src, size_t n, unsigned char *dst, size_t raw_len) {
+    if (n != raw_len) return 0;
+    memcpy(dst, src, n);
+    return 1;
+}
+
+/* small LZ77: a token byte holds literal and match lengths (4 bits each,
+   15 = more length bytes follow), then literals, then a 2-byte offset.
+   Matches are at least 4 bytes; the last sequence has literals only. */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 13
+#define LZ_WINDOW 65535
+
+static size_t lz_bound(size_t n) { return n + n / 255 + 16; }
+
+static unsigned lz_hash(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char *lz_put_len(unsigned char *o, size_t len) {
+    for (; len >= 255; len -= 255) *o++ = 255;
+    *o++ = (unsigned char)len;
+    return o;
+}
+
+static unsigned char *lz_sequence(unsigned char *o, const unsigned char *lit, size_t nlit,
+                                  size_t offset, size_t mlen) {
+    size_t m = mlen ? mlen - LZ_MIN_MATCH : 0;
+    *o++ = (unsigned char)((nlit < 15 ? nlit : 15) << 4 | (m < 15 ? m : 15));
+    if (nlit >= 15) o = lz_put_len(o, nlit - 15);
+    memcpy(o, lit, nlit);
+    o += nlit;
+    if (!mlen) return o;
+    *o++ = (unsigned char)(offset & 0xFF);
+    *o++ = (unsigned char)(offset >> 8);
+    if (m >= 15) o = lz_put_len(o, m - 15);
+    return o;
+}
+
+static size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0xFF, sizeof table);
+    unsigned char *o = dst;
+    size_t anchor = 0, i = 0;
+    while (n >= LZ_MIN_MATCH && i + LZ_MIN_MATCH <= n) {
+        unsigned h = lz_hash(src + i);
+        uint32_t cand = table[h];
+        table[h] = (uint32_t)i;
+        if (cand != UINT32_MAX && i - cand <= LZ_WINDOW && memcmp(src + cand, src + i, LZ_MIN_MATCH) == 0) {
+            size_t len = LZ_MIN_MATCH;
+            while (i + len < n && src[cand + len] == src[i + len]) len++;
+            o = lz_sequence(o, src + anchor, i - anchor, i - cand, len);
+            i += len;
+            anchor = i;
+        } else {
+            i++;
+        }
+    }
+    o = lz_sequence(o, src + anchor, n - anchor, 0, 0);
+    return (size_t)(o - dst);
+}
+
+static int lz_get_len(const unsigned char **p, const unsigned char *end, size_t *len) {
+    unsigned char c;
+    do {
+        if (*p >= end) return 0;
+        c = *(*p)++;
+        *len += c;
+    } while (c == 255);
+    return 1;
+}
+
+static int lz_decompress(const unsigned char *src, size_t n, unsigned char *dst, size_t raw_len) {
+    const unsigned char *p = src, *end = src + n;
+    unsigned char *o = dst, *oend = dst + raw_len;
+    while (p < end) {
+        unsigned tok = *p++;
+        size_t nlit = tok >> 4;
+        if (nlit == 15 && !lz_get_len(&p, end, &nlit)) return 0;
+        if (nlit > (size_t)(end - p) || nlit > (size_t)(oend - o)) return 0;
+        memcpy(o, p, nlit);
+        o += nlit;
+        p += nlit;
+        if (p == end) break; /* last sequence */
+        if (end - p < 2) return 0;
+        size_t offset = (size_t)p[0] | (size_t)p[1] << 8;
+        p += 2;
+        size_t mlen = tok & 15;
+        if (mlen == 15 && !lz_get_len(&p, end, &mlen)) return 0;
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(o - dst) || mlen > (size_t)(oend - o)) return 0;
+        const unsigned char *m = o - offset;
+        if (offset >= mlen) { memcpy(o, m, mlen); o += mlen; }
+        else while (mlen--) *o++ = *m++;
+    }
+    return o == oend;
+}
+
+static const BlockCodec codecs[CODEC_COUNT] = {
+    { "none", none_bound, none_compress, none_decompress },
+    { "lz", lz_bound, lz_compress, lz_decompress },
+};
+
+const BlockCodec *pack_codec(int id) {
+    return id >= 0 && id < CODEC_COUNT ? &codecs[id] : NULL;
+}
@@ -0,0 +1,27 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include "finance.h"
+
+#define PACK_BLOCK_ROWS 4096
+
+/* block compressors; the codec id is stored with every block */
+enum { CODEC_NONE = 0, CODEC_LZ = 1, CODEC_COUNT };
+
+typedef struct {
+    const char *name;
+    size_t (*bound)(size_t n);      /* worst-case output for n input bytes */
+    size_t (*compress)(const unsigned char *src, size_t n, unsigned char *dst); /* 0 = failed */
+    int (*decompress)(const unsigned char *src, size_t n, unsigned char *dst, size_t raw_len);
+} BlockCodec;
+
+const BlockCodec *pack_codec(int id);
+
+/* one block of rows: zigzag varint deltas for ids and date keys, zigzag
+   varint cents, varint category ids, then length-prefixed descriptions */
+size_t pack_bound(int n);
+size_t pack_rows(const ExpenseDB *db, const int *slots, int first, int n, unsigned char *out);
+int unpack_rows(const unsigned char *raw, size_t len, Expense *out, int n, int legacy, const char **text);
+
+#endif
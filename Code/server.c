@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "server.h"
+#include "journal.h"
+#include "kernels.h"
+#include "stats.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVER_LINE 2048
+#define SERVER_MAX_CLIENTS 256
+#define SERVER_FIELDS 6
+
+/* requests are one line: a command word, then fields separated by tabs,
+   or by spaces when the line has no tab (the last field then takes the
+   rest of the line). "-" is an empty field. Every reply is a status line,
+   "OK ..." or "ERR ...", any body lines, then a line holding ".".
+
+   PING                          OK
+   INFO                          OK <rows> <next id> <first YYYYMMDD> <last YYYYMMDD>
+   ADD DD-MM-YYYY CAT AMOUNT [DESCRIPTION]   OK <id>; creates CAT if needed
+   DEL ID                        OK
+   GET ID                        OK, then the row
+   FILTER CAT FROM TO TEXT       OK, then the db_list_filtered listing
+   TOTALS CAT FROM TO TEXT       OK <count> <total> <min> <max>
+   SUMMARY MM-YYYY               OK, then the monthly summary
+   SAVE                          OK <rows saved>
+   STATS                         OK, then the performance counters
+   QUIT                          closes this connection
+   SHUTDOWN                      stops the server, which saves on the way out */
+
+typedef struct {
+    ExpenseDB *db;
+    const char *db_file, *path;
+    pthread_rwlock_t rw;        /* queries share it; changes hold it alone */
+    pthread_mutex_t save;       /* one SAVE at a time */
+    pthread_mutex_t lock;       /* guards fds and active */
+    pthread_cond_t idle;
+    int fds[SERVER_MAX_CLIENTS];
+    int active;
+} Server;
+
+typedef struct {
+    Server *sv;
+    int fd;
+} Client;
+
+static volatile sig_atomic_t server_stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof addr.sun_path) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) { close(fd); return -1; }
+    return fd;
+}
+
+static int send_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, 0);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return 0;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+static int split_fields(char *line, char **field, int max) {
+    const char *sep = strchr(line, '\t') ? "\t" : " ";
+    int n = 0;
+    while (*line && n < max) {
+        if (n == max - 1 && sep[0] == ' ') { field[n++] = line; break; }
+        field[n++] = line;
+        line += strcspn(line, sep);
+        if (*line) *line++ = '\0';
+        if (sep[0] == ' ') line += strspn(line, " ");
+    }
+    return n;
+}
+
+static const char *field_or_empty(int n, char **field, int i) {
+    return i < n && strcmp(field[i], "-") != 0 ? field[i] : "";
+}
+
+/* writes a db_snapshot copy with only the read lock held while copying;
+   the journal is emptied only if nothing was logged since the copy */
+static int server_save(Server *sv, int *rows) {
+    ExpenseDB snap;
+    pthread_mutex_lock(&sv->save);
+    pthread_rwlock_rdlock(&sv->rw);
+    int copied = db_snapshot(sv->db, &snap), ok = 0;
+    if (copied && sv->db->journal) sv->db->journal->save_running = 1;
+    pthread_rwlock_unlock(&sv->rw);
+    if (copied) {
+        ok = db_save_snapshot(&snap, sv->db_file);
+        *rows = snap.size;
+        pthread_rwlock_wrlock(&sv->rw);
+        Journal *j = sv->db->journal;
+        if (j) {
+            j->save_running = 0;
+            if (ok && sv->db->journal_seq == snap.journal_seq) journal_reset(j);
+        }
+        pthread_rwlock_unlock(&sv->rw);
+        db_free(&snap);
+    }
+    pthread_mutex_unlock(&sv->save);
+    return ok;
+}
+
+static void wake_accept(const char *path) {
+    int fd = connect_to(path);
+    if (fd >= 0) close(fd);
+}
+
+static int handle_add(Server *sv, int n, char **f, FILE *out) {
+    Expense e;
+    long long cents;
+    memset(&e, 0, sizeof e);
+    if (n < 4) { fputs("ERR usage: ADD DD-MM-YYYY CATEGORY AMOUNT [DESCRIPTION]\n", out); return 1; }
+    if (!is_valid_date(f[1])) { fputs("ERR bad date\n", out); return 1; }
+    if (!parse_amount(f[3], &cents)) { fputs("ERR bad amount\n", out); return 1; }
+    if (strlen(f[2]) >= CAT_LEN || strcmp(f[2], "-") == 0) { fputs("ERR bad category\n", out); return 1; }
+    if (strlen(field_or_empty(n, f, 4)) >= DESCRIPTION_LEN) { fputs("ERR description too long\n", out); return 1; }
+    strcpy(e.date, f[1]);
+    e.amount = cents;
+    pthread_rwlock_wrlock(&sv->rw);
+    ExpenseDB *db = sv->db;
+    e.cat_id = category_find(db, f[2]);
+    if (e.cat_id < 0 && add_category(db, f[2])) e.cat_id = category_find(db, f[2]);
+    int ok = e.cat_id >= 0 && db_add(db, e, field_or_empty(n, f, 4));
+    int id = db->next_id - 1;
+    pthread_rwlock_unlock(&sv->rw);
+    if (ok) fprintf(out, "OK %d\n", id);
+    else fputs("ERR out of memory\n", out);
+    return 1;
+}
+
+/* runs one request, writing the reply except the closing "."; 0 = hang up */
+static int handle(Server *sv, char *line, FILE *out) {
+    char *f[SERVER_FIELDS];
+    int n = split_fields(line, f, strncmp(line, "ADD", 3) == 0 ? 5 : SERVER_FIELDS);
+    ExpenseDB *db = sv->db;
+    char amt[AMOUNT_BUF];
+    if (n == 0) {
+        fputs("ERR empty request\n", out);
+    } else if (strcmp(f[0], "PING") == 0) {
+        fputs("OK\n", out);
+    } else if (strcmp(f[0], "INFO") == 0) {
+        pthread_rwlock_rdlock(&sv->rw);
+        int first = 0, last = 0;
+        db_date_span(db, &first, &last);
+        fprintf(out, "OK %d %d %d %d\n", db->live, db->next_id, first, last);
+        pthread_rwlock_unlock(&sv->rw);
+    } else if (strcmp(f[0], "ADD") == 0) {
+        handle_add(sv, n, f, out);
+    } else if (strcmp(f[0], "DEL") == 0 || strcmp(f[0], "GET") == 0) {
+        int id = n > 1 ? atoi(f[1]) : 0;
+        if (f[0][0] == 'D') {
+            pthread_rwlock_wrlock(&sv->rw);
+            int ok = id > 0 && db_delete_by_id(db, id);
+            pthread_rwlock_unlock(&sv->rw);
+            fputs(ok ? "OK\n" : "ERR ID not found\n", out);
+        } else {
+            pthread_rwlock_rdlock(&sv->rw);
+            int i = id > 0 ? db_find_index_by_id(db, id) : -1;
+            if (i < 0) {
+                fputs("ERR ID not found\n", out);
+            } else {
+                const Expense *e = &db->arr[i];
+                fprintf(out, "OK\n%-3d %-10s  %8s  %-12s  %s\n", e->id, e->date, format_amount(e->amount, amt),
+                        category_name(db, e->cat_id), expense_description(db, e));
+            }
+            pthread_rwlock_unlock(&sv->rw);
+        }
+    } else if (strcmp(f[0], "FILTER") == 0 || strcmp(f[0], "TOTALS") == 0) {
+        const char *cat = field_or_empty(n, f, 1), *from = field_or_empty(n, f, 2);
+        const char *to = field_or_empty(n, f, 3), *text = field_or_empty(n, f, 4);
+        if ((from[0] && !is_valid_date(from)) || (to[0] && !is_valid_date(to))) {
+            fputs("ERR bad date\n", out);
+        } else if (f[0][0] == 'F') {
+            fputs("OK\n", out);
+            pthread_rwlock_rdlock(&sv->rw);
+            db_list_filtered_to(out, db, cat, from, to, text);
+            pthread_rwlock_unlock(&sv->rw);
+        } else {
+            AggGroup t;
+            char lo[AMOUNT_BUF], hi[AMOUNT_BUF];
+            pthread_rwlock_rdlock(&sv->rw);
+            db_filter_totals(db, cat, from, to, text, &t);
+            pthread_rwlock_unlock(&sv->rw);
+            fprintf(out, "OK %d %s %s %s\n", t.count, format_amount(t.sum, amt), format_amount(t.min, lo),
+                    format_amount(t.max, hi));
+        }
+    } else if (strcmp(f[0], "SUMMARY") == 0) {
+        if (n < 2) {
+            fputs("ERR usage: SUMMARY MM-YYYY\n", out);
+        } else {
+            fputs("OK\n", out);
+            pthread_rwlock_rdlock(&sv->rw);
+            db_monthly_summary_to(out, db, f[1]);
+            pthread_rwlock_unlock(&sv->rw);
+        }
+    } else if (strcmp(f[0], "SAVE") == 0) {
+        int rows = 0;
+        if (server_save(sv, &rows)) fprintf(out, "OK %d\n", rows);
+        else fputs("ERR save failed\n", out);
+    } else if (strcmp(f[0], "STATS") == 0) {
+        fputs("OK\n", out);
+        stats_print(out);
+    } else if (strcmp(f[0], "QUIT") == 0) {
+        fputs("OK\n", out);
+        return 0;
+    } else if (strcmp(f[0], "SHUTDOWN") == 0) {
+        fputs("OK\n", out);
+        server_stop = 1;
+        wake_accept(sv->path);
+        return 0;
+    } else {
+        fprintf(out, "ERR unknown command %s\n", f[0]);
+    }
+    return 1;
+}
+
+static void client_leave(Server *sv, int fd) {
+    pthread_mutex_lock(&sv->lock);
+    for (int i = 0; i < sv->active; ++i)
+        if (sv->fds[i] == fd) { sv->fds[i] = sv->fds[--sv->active]; break; }
+    pthread_cond_signal(&sv->idle);
+    pthread_mutex_unlock(&sv->lock);
+}
+
+/* replies are built in memory under the lock and sent after it is
+   dropped, so a slow client never holds up writers */
+static void *client_thread(void *arg) {
+    Client *c = arg;
+    Server *sv = c->sv;
+    int fd = c->fd;
+    free(c);
+    FILE *in = fdopen(fd, "r");
+    char line[SERVER_LINE];
+    while (in && fgets(line, sizeof line, in)) {
+        char *reply = NULL;
+        size_t len = 0;
+        FILE *out = open_memstream(&reply, &len);
+        if (!out) break;
+        int keep = 1;
+        if (!strchr(line, '\n') && !feof(in)) {
+            int ch;
+            while ((ch = fgetc(in)) != EOF && ch != '\n') {}
+            fputs("ERR request too long\n", out);
+        } else {
+            line[strcspn(line, "\r\n")] = '\0';
+            keep = handle(sv, line, out);
+        }
+        fputs(".\n", out);
+        fclose(out);
+        int sent = send_all(fd, reply, len);
+        free(reply);
+        if (!keep || !sent) break;
+    }
+    client_leave(sv, fd);
+    if (in) fclose(in);
+    else close(fd);
+    return NULL;
+}
+
+static int start_client(Server *sv, int fd) {
+    pthread_mutex_lock(&sv->lock);
+    int room = sv->active < SERVER_MAX_CLIENTS;
+    if (room) sv->fds[sv->active++] = fd;
+    pthread_mutex_unlock(&sv->lock);
+    if (!room) {
+        send_all(fd, "ERR too many clients\n.\n", 23);
+        close(fd);
+        return 0;
+    }
+    Client *c = malloc(sizeof *c);
+    pthread_t t;
+    pthread_attr_t attr;
+    sigset_t block, old;
+    /* client threads leave SIGINT/SIGTERM to the accept loop */
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ok = c != NULL;
+    if (ok) {
+        c->sv = sv;
+        c->fd = fd;
+        ok = pthread_create(&t, &attr, client_thread, c) == 0;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (!ok) {
+        free(c);
+        client_leave(sv, fd);
+        close(fd);
+    }
+    return ok;
+}
+
+int serve(ExpenseDB *db, const char *db_file, const char *socket_path) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof addr.sun_path) {
+        printf("Socket path too long: %s\n", socket_path);
+        return 0;
+    }
+    int probe = connect_to(socket_path);
+    if (probe >= 0) {
+        close(probe);
+        printf("A server is already listening on %s\n", socket_path);
+        return 0;
+    }
+    unlink(socket_path);    /* left over from a server that died */
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(lfd, 64) != 0) {
+        perror(socket_path);
+        if (lfd >= 0) close(lfd);
+        return 0;
+    }
+
+    Server sv;
+    memset(&sv, 0, sizeof sv);
+    sv.db = db;
+    sv.db_file = db_file;
+    sv.path = socket_path;
+    pthread_rwlockattr_t rwattr;
+    pthread_rwlockattr_init(&rwattr);
+#ifdef __GLIBC__
+    /* glibc favours readers by default, which can starve ADD/DEL */
+    pthread_rwlockattr_setkind_np(&rwattr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&sv.rw, &rwattr);
+    pthread_rwlockattr_destroy(&rwattr);
+    pthread_mutex_init(&sv.save, NULL);
+    pthread_mutex_init(&sv.lock, NULL);
+    pthread_cond_init(&sv.idle, NULL);
+    col_kernel_name();  /* picks the stats kernel before any thread needs it */
+
+    struct sigaction sa, old_int, old_term, old_pipe;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_signal;  /* no SA_RESTART: accept must return */
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, &old_pipe);
+    server_stop = 0;
+
+    printf("Serving %s (%d expenses) on %s; Ctrl+C or SHUTDOWN stops.\n", db_file, db->live, socket_path);
+    fflush(stdout);
+    while (!server_stop) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR && !server_stop) perror("accept");
+            continue;
+        }
+        if (server_stop) close(fd);
+        else start_client(&sv, fd);
+    }
+    close(lfd);
+    unlink(socket_path);
+
+    /* hang up on everyone and wait for their threads */
+    pthread_mutex_lock(&sv.lock);
+    for (int i = 0; i < sv.active; ++i) shutdown(sv.fds[i], SHUT_RDWR);
+    while (sv.active > 0) pthread_cond_wait(&sv.idle, &sv.lock);
+    pthread_mutex_unlock(&sv.lock);
+
+    printf("Stopping. Saving to %s\n", db_file);
+    if (!db_save_binary(db, db_file)) puts("Save failed.");
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    pthread_cond_destroy(&sv.idle);
+    pthread_mutex_destroy(&sv.lock);
+    pthread_mutex_destroy(&sv.save);
+    pthread_rwlock_destroy(&sv.rw);
+    return 1;
+}
+
+/* ---- load generator ---- */
+
+typedef struct {
+    const char *path;
+    int requests, write_pct;
+    unsigned seed;
+    int next_id, first_month, months;   /* from INFO */
+    double *read_us, *write_us;
+    int reads, writes, errors;
+    int connected;
+} LoadClient;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static unsigned next_rand(unsigned *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+/* sends one request and reads to the closing "."; status gets the first
+   line. Returns 0 if the connection broke. */
+static int round_trip(int fd, FILE *in, const char *req, char *status, size_t n) {
+    char line[SERVER_LINE];
+    if (!send_all(fd, req, strlen(req))) return 0;
+    status[0] = '\0';
+    for (int first = 1; fgets(line, sizeof line, in); first = 0) {
+        if (strcmp(line, ".\n") == 0) return 1;
+        if (first) {
+            size_t len = strlen(line) < n ? strlen(line) : n - 1;
+            memcpy(status, line, len);
+            status[len] = '\0';
+        }
+    }
+    return 0;
+}
+
+static void *load_thread(void *arg) {
+    LoadClient *lc = arg;
+    int fd = connect_to(lc->path);
+    FILE *in = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!in) {
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    lc->connected = 1;
+    char req[160], status[160];
+    int pending = 0;    /* id this client added and has yet to delete */
+    for (int r = 0; r < lc->requests; ++r) {
+        unsigned x = next_rand(&lc->seed);
+        int write = (int)(x % 100) < lc->write_pct;
+        int ym = lc->first_month + (int)(next_rand(&lc->seed) % (unsigned)lc->months);
+        int year = ym / 12, month = ym % 12 + 1, day = 1 + (int)(next_rand(&lc->seed) % 28);
+        int last = month == 2 ? 28 + (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+                              : 30 + ((month + (month > 7)) & 1);
+        if (write && pending) {
+            snprintf(req, sizeof req, "DEL %d\n", pending);
+        } else if (write) {
+            snprintf(req, sizeof req, "ADD\t%02d-%02d-%04d\tloadgen\t1.00\tloadgen\n", day, month, year);
+        } else {
+            switch (x / 100 % 10) {
+            case 0: case 1: case 2: case 3:
+                snprintf(req, sizeof req, "TOTALS - 01-%02d-%04d %02d-%02d-%04d -\n", month, year, last, month, year);
+                break;
+            case 4: case 5: case 6:
+                snprintf(req, sizeof req, "SUMMARY %02d-%04d\n", month, year);
+                break;
+            case 7: case 8:
+                snprintf(req, sizeof req, "GET %d\n", 1 + (int)(next_rand(&lc->seed) % (unsigned)lc->next_id));
+                break;
+            default:
+                snprintf(req, sizeof req, "FILTER - %02d-%02d-%04d %02d-%02d-%04d -\n", day, month, year, day, month, year);
+            }
+        }
+        double t0 = now_us();
+        if (!round_trip(fd, in, req, status, sizeof status)) { lc->errors++; break; }
+        double us = now_us() - t0;
+        if (write) lc->write_us[lc->writes++] = us;
+        else lc->read_us[lc->reads++] = us;
+        if (strncmp(status, "OK", 2) != 0 && !(strncmp(req, "GET", 3) == 0)) lc->errors++;
+        if (write) pending = pending ? 0 : atoi(status + 2);
+    }
+    if (pending) {
+        snprintf(req, sizeof req, "DEL %d\n", pending);
+        round_trip(fd, in, req, status, sizeof status);
+    }
+    fclose(in);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_latency(const char *label, double *us, int n) {
+    if (n == 0) { printf("%-7s %9d\n", label, 0); return; }
+    qsort(us, (size_t)n, sizeof *us, cmp_double);
+    double sum = 0;
+    for (int i = 0; i < n; ++i) sum += us[i];
+    printf("%-7s %9d %9.1f %9.1f %9.1f %9.1f\n", label, n, sum / n, us[n / 2], us[(int)((n - 1) * 0.99)], us[n - 1]);
+}
+
+int loadgen(const char *socket_path, int clients, int requests, int write_pct) {
+    char status[160];
+    int rows, next_id, first, last;
+    int fd = connect_to(socket_path);
+    FILE *in = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!in || !round_trip(fd, in, "INFO\n", status, sizeof status) ||
+        sscanf(status, "OK %d %d %d %d", &rows, &next_id, &first, &last) != 4) {
+        printf("No server answering on %s\n", socket_path);
+        if (in) fclose(in);
+        else if (fd >= 0) close(fd);
+        return 0;
+    }
+    fclose(in);
+    if (first <= 0) first = last = 20250101;   /* empty ledger: any month will do */
+
+    LoadClient *lc = calloc((size_t)clients, sizeof *lc);
+    pthread_t *tid = malloc((size_t)clients * sizeof *tid);
+    double *lat = malloc((size_t)clients * requests * 3 * sizeof *lat);
+    if (!lc || !tid || !lat) { free(lc); free(tid); free(lat); puts("Out of memory."); return 0; }
+    for (int c = 0; c < clients; ++c) {
+        lc[c].path = socket_path;
+        lc[c].requests = requests;
+        lc[c].write_pct = write_pct;
+        lc[c].seed = 2463534242u + 7919u * (unsigned)c;
+        lc[c].next_id = next_id > 1 ? next_id - 1 : 1;
+        lc[c].first_month = first / 10000 * 12 + first / 100 % 100 - 1;
+        lc[c].months = last / 10000 * 12 + last / 100 % 100 - lc[c].first_month;
+        lc[c].read_us = lat + (size_t)c * requests * 2;
+        lc[c].write_us = lc[c].read_us + requests;
+    }
+    printf("%d client(s) x %d requests, %d%% writes, against %d expenses on %s\n", clients, requests, write_pct,
+           rows, socket_path);
+    double t0 = now_us();
+    int started = 0;
+    while (started < clients && pthread_create(&tid[started], NULL, load_thread, &lc[started]) == 0) started++;
+    for (int c = 0; c < started; ++c) pthread_join(tid[c], NULL);
+    double secs = (now_us() - t0) / 1e6;
+
+    int reads = 0, writes = 0, errors = 0, connected = 0;
+    for (int c = 0; c < started; ++c) {
+        reads += lc[c].reads;
+        writes += lc[c].writes;
+        errors += lc[c].errors;
+        connected += lc[c].connected;
+    }
+    /* every read sample, then every write sample, after the per-client ones */
+    double *merged = lat + (size_t)clients * requests * 2;
+    int m = 0;
+    for (int c = 0; c < started; ++c) {
+        memcpy(merged + m, lc[c].read_us, (size_t)lc[c].reads * sizeof *lat);
+        m += lc[c].reads;
+    }
+    for (int c = 0; c < started; ++c) {
+        memcpy(merged + m, lc[c].write_us, (size_t)lc[c].writes * sizeof *lat);
+        m += lc[c].writes;
+    }
+    printf("%d of %d client(s) connected; %d requests in %.3f s = %.0f QPS, %d error(s)\n", connected, clients,
+           m, secs, secs > 0 ? m / secs : 0.0, errors);
+    puts("          count   mean us    p50 us    p99 us    max us");
+    print_latency("reads", merged, reads);
+    print_latency("writes", merged + reads, writes);
+    print_latency("all", merged, m);
+    free(lat);
+    free(tid);
+    free(lc);
+    return connected > 0;
+}
+
+#else
+
+int serve(ExpenseDB *db, const char *db_file, const char *socket_path) {
+    (void)db; (void)db_file; (void)socket_path;
+    puts("Server mode needs Unix domain sockets and is not available on Windows.");
+    return 0;
+}
+
+int loadgen(const char *socket_path, int clients, int requests, int write_pct) {
+    (void)socket_path; (void)clients; (void)requests; (void)write_pct;
+    puts("The load generator is not available on Windows.");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "finance.h"
+
+#define SERVER_SOCKET "data/finance.sock"
+
+/* owns db and answers a line protocol on a Unix socket, one thread per
+   client: queries share a read lock, changes take it exclusively. Runs
+   until SIGINT/SIGTERM or a SHUTDOWN request, then saves db_file.
+   Returns 0 if the socket could not be set up. */
+int serve(ExpenseDB *db, const char *db_file, const char *socket_path);
+
+/* clients connections each send requests queries, write_pct percent of
+   them ADD/DEL pairs that leave the ledger as it was; prints QPS and
+   latency percentiles. Returns 0 if the server could not be reached. */
+int loadgen(const char *socket_path, int clients, int requests, int write_pct);
+
+#endif
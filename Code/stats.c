@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+#ifndef FINANCE_NO_STATS
+
+static const char *const OP_NAMES[SOP_COUNT] = {
+    "add", "delete", "delete_where", "compact",
+    "list", "list_grouped", "filter", "filter_totals",
+    "monthly_summary", "all_months", "aggregate",
+    "save", "save_snapshot", "load", "save_sharded", "load_sharded",
+    "export_csv", "import_csv", "journal_replay",
+    "range_total", "rolling", "top_k", "percentiles",
+};
+
+FinanceStats finance_stats;
+
+void stat_op(int op, unsigned long long start, unsigned long long rows) {
+    unsigned long long ns = stat_clock() - start;
+    OpStats *s = &finance_stats.ops[op];
+    STAT_ADD(s->calls, 1);
+    STAT_ADD(s->total_ns, ns);
+    STAT_ADD(s->rows, rows);
+#ifdef _WIN32
+    if (ns > s->max_ns) s->max_ns = ns;
+#else
+    unsigned long long cur = __atomic_load_n(&s->max_ns, __ATOMIC_RELAXED);
+    while (ns > cur && !__atomic_compare_exchange_n(&s->max_ns, &cur, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+#endif
+}
+
+void stats_get(FinanceStats *out) {
+    *out = finance_stats;
+}
+
+void stats_reset(void) {
+    memset(&finance_stats, 0, sizeof finance_stats);
+}
+
+void stats_print(FILE *out) {
+    FinanceStats st;
+    stats_get(&st);
+    int any = 0;
+    for (int op = 0; op < SOP_COUNT; ++op) {
+        const OpStats *s = &st.ops[op];
+        if (!s->calls) continue;
+        if (!any) {
+            fprintf(out, "Operation          Calls    Total ms      Avg us      Max us         Rows\n");
+            fprintf(out, "--------------------------------------------------------------------------\n");
+            any = 1;
+        }
+        fprintf(out, "%-16s %7llu %11.3f %11.2f %11.2f %12llu\n", OP_NAMES[op], s->calls, s->total_ns / 1e6,
+                s->total_ns / 1e3 / s->calls, s->max_ns / 1e3, s->rows);
+    }
+    if (!any) fputs("No operations recorded yet.\n", out);
+    fprintf(out, "Bytes read: %llu, written: %llu\n", st.bytes_read, st.bytes_written);
+    fprintf(out, "Row arrays grown %llu time(s), %llu bytes requested\n", st.grows, st.grow_bytes);
+}
+
+#else
+
+void stats_get(FinanceStats *out) {
+    memset(out, 0, sizeof *out);
+}
+
+void stats_reset(void) {}
+
+void stats_print(FILE *out) {
+    fputs("Statistics were compiled out (FINANCE_NO_STATS).\n", out);
+}
+
+#endif
+
+static const char *dump_target;
+
+static void dump_stats(void) {
+    FILE *f = strcmp(dump_target, "1") == 0 ? stderr : fopen(dump_target, "a");
+    if (!f) return;
+    stats_print(f);
+    if (f != stderr) fclose(f);
+}
+
+void stats_dump_at_exit(void) {
+    const char *env = getenv("FINANCE_STATS");
+    if (!env || !env[0] || strcmp(env, "0") == 0 || dump_target) return;
+    dump_target = env;
+    atexit(dump_stats);
+}
@@ -0,0 +1,76 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* per-operation counters for the library's hot paths. Building with
+   -DFINANCE_NO_STATS turns every STAT_ macro into nothing. */
+enum {
+    SOP_ADD, SOP_DELETE, SOP_DELETE_WHERE, SOP_COMPACT,
+    SOP_LIST, SOP_LIST_GROUPED, SOP_FILTER, SOP_FILTER_TOTALS,
+    SOP_MONTHLY_SUMMARY, SOP_ALL_MONTHS, SOP_AGGREGATE,
+    SOP_SAVE, SOP_SAVE_SNAPSHOT, SOP_LOAD, SOP_SAVE_SHARDED, SOP_LOAD_SHARDED,
+    SOP_EXPORT_CSV, SOP_IMPORT_CSV, SOP_JOURNAL_REPLAY,
+    SOP_RANGE_TOTAL, SOP_ROLLING, SOP_TOP_K, SOP_PERCENTILE,
+    SOP_COUNT
+};
+
+typedef struct {
+    unsigned long long calls;
+    unsigned long long total_ns, max_ns;
+    unsigned long long rows;        /* rows visited, written or read */
+} OpStats;
+
+typedef struct {
+    OpStats ops[SOP_COUNT];
+    unsigned long long bytes_read, bytes_written;
+    unsigned long long grows;       /* row array reallocations */
+    unsigned long long grow_bytes;  /* bytes those reallocations asked for */
+} FinanceStats;
+
+void stats_get(FinanceStats *out);
+void stats_reset(void);
+void stats_print(FILE *out);
+/* FINANCE_STATS=1 prints the counters to stderr at exit, any other
+   non-zero value is a file to append them to */
+void stats_dump_at_exit(void);
+
+#ifndef FINANCE_NO_STATS
+
+#include <time.h>
+
+extern FinanceStats finance_stats;
+
+static inline unsigned long long stat_clock(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+/* relaxed atomics: the server runs queries on several threads at once */
+#ifdef _WIN32
+  #define STAT_ADD(field, n) ((field) += (n))
+#else
+  #define STAT_ADD(field, n) __atomic_add_fetch(&(field), (n), __ATOMIC_RELAXED)
+#endif
+
+void stat_op(int op, unsigned long long start, unsigned long long rows);
+
+#define STAT_START(t) unsigned long long t = stat_clock()
+#define STAT_STOP(op, t, rows) stat_op((op), (t), (unsigned long long)(rows))
+#define STAT_COUNT(field, n) STAT_ADD(finance_stats.field, (unsigned long long)(n))
+
+#else
+
+/* sizeof keeps the arguments "used" without evaluating them */
+#define STAT_START(t) ((void)0)
+#define STAT_STOP(op, t, rows) ((void)sizeof(rows))
+#define STAT_COUNT(field, n) ((void)sizeof(n))
+
+#endif
+
+#endif